@@ -93,12 +93,12 @@ using Name = NameData*;
 #define TYPE_ALIGN(align, size) \
   (((std::size_t)(size) + (align - 1)) & ~(align - 1))
 
-#define ALIGNOF_SHORT         _Alignof(short)
-#define ALIGNOF_INT           _Alignof(int)
-#define ALIGNOF_LONG          _Alignof(long)
-#define ALIGNOF_LONG_LONG_INT _Alignof(long long)
-#define ALIGNOF_DOUBLE        _Alignof(double)
-#define MAXIMUM_ALIGNOF       _Alignof(max_align_t)
+#define ALIGNOF_SHORT         alignof(short)
+#define ALIGNOF_INT           alignof(int)
+#define ALIGNOF_LONG          alignof(long)
+#define ALIGNOF_LONG_LONG_INT alignof(long long)
+#define ALIGNOF_DOUBLE        alignof(double)
+#define MAXIMUM_ALIGNOF       alignof(max_align_t)
 
 #define SHORT_ALIGN(size)  TYPE_ALIGN(ALIGNOF_SHORT, (size))
 #define INT_ALIGN(size)    TYPE_ALIGN(ALIGNOF_INT, (size))
@@ -106,4 +106,9 @@ using Name = NameData*;
 #define DOUBLE_ALIGN(size) TYPE_ALIGN(ALIGNOF_DOUBLE, (size))
 #define MAX_ALIGN(size)    TYPE_ALIGN(MAXIMUM_ALIGNOF, (size))
 
+// Size of a CPU cache line. Data that different processes or threads update
+// concurrently is aligned to it to avoid false sharing.
+#define CACHE_LINE_SIZE        64
+#define CACHE_LINE_ALIGN(size) TYPE_ALIGN(CACHE_LINE_SIZE, (size))
+
 }  // namespace rdbms
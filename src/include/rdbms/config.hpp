@@ -6,6 +6,18 @@ namespace rdbms {
 #define DEF_MAX_BACKENDS    32
 #define USE_ASSERT_CHECKING 1
 
+// If 1, AllocSetContext marks the byte past the requested size of every chunk
+// and checks it on realloc() and check(), and clobbers freed chunks. This
+// costs a store per allocation and a memset per free, so it is only on by
+// default in builds with assertions.
+#ifndef MEMORY_CONTEXT_CHECKING
+#ifdef NDEBUG
+#define MEMORY_CONTEXT_CHECKING 0
+#else
+#define MEMORY_CONTEXT_CHECKING 1
+#endif
+#endif
+
 #define MAX_BACKENDS   (DEF_MAX_BACKENDS > 1024 ? DEF_MAX_BACKENDS : 1024)
 #define DEF_NBUFFERS   (DEF_MAX_BACKENDS > 8 ? DEF_MAX_BACKENDS * 2 : 16)
 #define BLCKSZ         8192
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <string>
+
 #include "rdbms/postgres.hpp"
 
 namespace rdbms {
@@ -103,6 +105,8 @@ typedef enum NodeTag {
   // TAGS FOR MEMORY NODES (memnodes.h)
   kMemoryContext = 400,
   kAllocSetContext,
+  kSlabContext,
+  kGenerationContext,
 
   // TAGS FOR VALUE NODES (pg_list.h)
   kValue = 500,
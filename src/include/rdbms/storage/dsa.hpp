@@ -0,0 +1,99 @@
+#pragma once
+
+#include <memory>
+
+#include "rdbms/storage/dsm.hpp"
+#include "rdbms/storage/slock.hpp"
+
+namespace rdbms {
+
+// A relative pointer into a DsaArea: the index of a segment in the upper
+// bits and an offset into it in the lower kDsaOffsetBits. It means the same
+// thing in every process attached to the area, unlike the address that
+// DsaArea::get_address() translates it into.
+using DsaPointer = u64;
+
+inline constexpr DsaPointer kInvalidDsaPointer = 0;
+inline constexpr int kDsaOffsetBits = 40;
+
+// DsaArea carves variable-size chunks out of a growing set of DsmSegments,
+// so parallel workers can build hash tables, tuple queues and sort runs in
+// shared memory without sizing the main segment for the worst case.
+//
+// The area starts with one segment holding its control data, and creates
+// another segment whenever the current one is full, twice as big as the
+// previous one up to kMaxSegmentSize. Any attached process may grow the
+// area; the others map new segments the first time they translate a pointer
+// into one.
+//
+// Chunks up to kMaxSmallChunk bytes, header included, are rounded up to a
+// power of 2 and recycled through one freelist per size class. Bigger chunks
+// are recycled first-fit through a single list. Space is only returned to
+// the system when the area is destroyed. A spinlock in the control data
+// serializes alloc() and free() across processes.
+//
+// The creator of the area owns its segments and removes them when it goes
+// away. A DsaArea object is meant to be used by a single thread.
+class DsaArea {
+ public:
+  static constexpr Size kDefaultInitSegmentSize = 1024 * 1024;
+  static constexpr Size kMaxSegmentSize = Size{1} << 30;
+  static constexpr Size kMaxSmallChunk = 64 * 1024;
+  static constexpr int kMaxSegments = 256;
+
+  // Create an area whose first segment is `init_segment_size` bytes.
+  explicit DsaArea(Size init_segment_size = kDefaultInitSegmentSize);
+
+  // Attach to the area created with `handle`.
+  explicit DsaArea(DsmHandle handle);
+
+  ~DsaArea();
+
+  DsaArea(const DsaArea&) = delete;
+  DsaArea& operator=(const DsaArea&) = delete;
+
+  // Handle to pass to other processes so they can attach.
+  DsmHandle handle() const;
+
+  // Allocate `size` bytes, max-aligned. Return kInvalidDsaPointer if no
+  // segment can be created.
+  DsaPointer alloc(Size size);
+  void free(DsaPointer dp);
+
+  // Address of `dp` in this process, mapping its segment if needed.
+  void* get_address(DsaPointer dp);
+
+  // Bytes in all segments of the area.
+  Size total_size();
+  int nsegments();
+
+  bool is_ok() const { return control_ != nullptr; }
+
+ private:
+  struct Control;
+
+  static constexpr int kNumSizeClasses = 13;  // 16 bytes to kMaxSmallChunk
+
+  static DsaPointer make_pointer(int index, Size offset) {
+    return (static_cast<DsaPointer>(index) << kDsaOffsetBits) | offset;
+  }
+
+  static int segment_index(DsaPointer dp) { return dp >> kDsaOffsetBits; }
+
+  static Size segment_offset(DsaPointer dp) {
+    return dp & ((DsaPointer{1} << kDsaOffsetBits) - 1);
+  }
+
+  // Carve a fresh chunk of `chunk_size` bytes from the last segment, or from
+  // a new one. Called with the lock held.
+  DsaPointer carve(Size chunk_size);
+  bool add_segment(Size min_size);
+
+  DsmSegment* segment(int index);
+
+  Control* control_;
+  bool owner_;
+  std::unique_ptr<DsmSegment> segments_[kMaxSegments];
+};
+
+}  // namespace rdbms
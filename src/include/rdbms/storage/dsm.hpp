@@ -0,0 +1,58 @@
+#pragma once
+
+#include "rdbms/postgres.hpp"
+
+namespace rdbms {
+
+// Names a segment across processes. A type of its own, so it cannot be
+// mistaken for a size.
+enum class DsmHandle : u32 {};
+
+inline constexpr DsmHandle kInvalidDsmHandle{0};
+
+// A dynamic shared memory segment, created at runtime rather than at
+// postmaster start like SharedMemory. Parallel workers use them to exchange
+// data whose size is only known once a query runs.
+//
+// Segments are POSIX shared memory objects named after their handle, mapped
+// with mmap(). Another process attaches to a segment by handle, at whatever
+// address mmap() picks, so data inside a segment must not hold pointers but
+// offsets; see DsaArea. shm_open() is used rather than memfd_create() since
+// a memfd cannot be opened by name from an unrelated process.
+//
+// The creator removes the segment when it detaches, unless told otherwise,
+// in which case remove() must be called once all processes are done with it.
+// Mappings live on after removal; only new attaches fail.
+class DsmSegment {
+ public:
+  // Create a segment of `size` bytes.
+  explicit DsmSegment(Size size, bool remove_on_detach = true);
+
+  // Attach to the segment created with `handle`.
+  explicit DsmSegment(DsmHandle handle);
+
+  ~DsmSegment();
+
+  DsmSegment(const DsmSegment&) = delete;
+  DsmSegment& operator=(const DsmSegment&) = delete;
+
+  static void remove(DsmHandle handle);
+
+  DsmHandle handle() const { return handle_; }
+  void* address() const { return address_; }
+  Size size() const { return size_; }
+
+  bool is_ok() const { return address_ != nullptr; }
+
+ private:
+  static void segment_name(DsmHandle handle, char* name, Size size);
+
+  void map(int fd, Size size);
+
+  DsmHandle handle_;
+  void* address_;
+  Size size_;
+  bool remove_on_detach_;
+};
+
+}  // namespace rdbms
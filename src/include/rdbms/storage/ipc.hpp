@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <atomic>
 #include <cstdlib>
 #include <functional>
 
@@ -112,6 +113,13 @@ class ExitManager {
   }
 };
 
+// Derive an IPC key from the device and inode of `path`, the data directory,
+// the way ftok(3) does. Instances with different data directories then probe
+// disjoint ranges of keys instead of all starting from 1, which keeps them
+// from running into each other's sets and segments at startup. Return -1 if
+// `path` cannot be stat()ed.
+key_t ipc_key_from_path(const char* path);
+
 class Semaphore {
  public:
   static constexpr int kPGSemaMagic = 537;
@@ -125,6 +133,13 @@ class Semaphore {
 
   ~Semaphore();
 
+  Semaphore(const Semaphore&) = delete;
+  Semaphore& operator=(const Semaphore&) = delete;
+
+  // Start probing for keys at `key`, see ipc_key_from_path(). Return false,
+  // leaving the key base alone, if `key` is not positive: 0 is IPC_PRIVATE.
+  static bool set_key_base(key_t key);
+
   // Get semaphore id.
   constexpr int id() const { return semid_; }
 
@@ -205,6 +220,11 @@ class BinarySemaphore {
   Semaphore sem_;
 };
 
+// Whether the main shared memory segment is backed by huge pages. With kTry
+// the segment falls back to regular pages if none are reserved; with kOn
+// creating the segment fails instead.
+enum class HugePages { kOff, kTry, kOn };
+
 // The shmctl() system call performs some control operations on the shared
 // memory area specified by shmid. Each shared memory segment has a data
 // structure associated with it, parts of which may be altered by shmctl()
@@ -263,30 +283,61 @@ class BinarySemaphore {
 // RETURN VALUES
 //  Upon successful completion, a value of 0 is returned. Otherwise, -1 is
 //  returned and the global variable errno is set to indicate the error.
+//
+// The main shared memory segment is an anonymous MAP_SHARED mapping, which
+// children inherit across fork(). Unlike a SysV segment it can be backed by
+// huge pages without SHM_HUGETLB privileges, and it is not capped by SHMMAX.
+// A tiny SysV segment holding a copy of the header serves as the interlock:
+// as long as any process of a cluster is alive it stays attached, so a new
+// postmaster does not start over a segment still in use.
+//
+// A multi-GB buffer pool takes a page fault and a TLB miss on first touch of
+// every page. With set_prefault_workers(), the creator touches the whole
+// segment at startup instead, splitting it among that many threads.
 class SharedMemory {
  public:
   SharedMemory(Size size, int permission, bool is_private = false);
   ~SharedMemory();
 
+  // Settings for segments created from now on.
+  static void set_huge_pages(HugePages huge_pages);
+  static void set_prefault_workers(int nworkers);
+
+  // Start probing for keys at `key`, see Semaphore::set_key_base().
+  static bool set_key_base(key_t key);
+
   constexpr bool is_ok() const { return is_private_ || shmid_ != kBadShmid; }
 
+  bool uses_huge_pages() const { return uses_huge_pages_; }
+
+  // Bytes mapped for the segment, rounded up to whole huge pages if it uses
+  // them.
+  Size mapped_size() const { return mapped_size_; }
+
  private:
   friend class ShmemAllocator;
 
+  // The header is followed by the space ShmemAllocator hands out. Every
+  // process bumps `free_offset` with an atomic compare-and-swap, so it must
+  // be lock-free to work across processes.
   struct PGShmemHeader {
-    PGShmemHeader(i32 _magic, pid_t _creator_pid, u32 _total_size,
-                  u32 _free_offset)
+    PGShmemHeader(i32 _magic, pid_t _creator_pid, Size _total_size,
+                  Size _free_offset)
         : magic(_magic),
           creator_pid(_creator_pid),
           total_size(_total_size),
-          free_offset(_free_offset) {}
-
-    i32 magic;          // magic # to identify Postgres segments
-    pid_t creator_pid;  // PID of creating process
-    u32 total_size;     // total size of segment
-    u32 free_offset;    // offset to first free space
+          free_offset(_free_offset),
+          index_offset(0) {}
+
+    i32 magic;                      // magic # to identify Postgres segments
+    pid_t creator_pid;              // PID of creating process
+    Size total_size;                // total size of segment
+    std::atomic<Size> free_offset;  // offset to first free space
+    Size index_offset;              // offset to the ShmemIndex, 0 if none
   };
 
+  static_assert(std::atomic<Size>::is_always_lock_free);
+
   static constexpr int kPGShmemMagic = 0x2885750c;
 
   static void* create_private_memory(Size size);
@@ -299,12 +350,21 @@ class SharedMemory {
   static void remove_shared_memory(int shmid);
   static bool discover_and_remove_legacy_shmem(key_t key);
 
+  // Map the anonymous segment, from huge pages if the setting asks for them.
+  void* map_anonymous(Size size);
+  static void prefault(void* ptr, Size size, Size page_size, int nworkers);
+
   static int next_key_;
+  static HugePages huge_pages_;
+  static int prefault_workers_;
   static constexpr int kBadShmid = -1;
 
   bool is_private_;
-  int shmid_;
+  int shmid_;  // Interlock segment
+  bool uses_huge_pages_;
+  Size mapped_size_;
   PGShmemHeader* shmaddr_;
+  PGShmemHeader* interlock_;
 };
 
 }  // namespace rdbms
\ No newline at end of file
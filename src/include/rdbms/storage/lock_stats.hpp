@@ -0,0 +1,101 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include "rdbms/storage/spin.hpp"
+
+namespace rdbms {
+
+// Ids under which lock waits are counted: the LockIds, plus one for all the
+// spinlocks without a LockId and one for SysV semaphores.
+inline constexpr int kOtherSpinLocks = kMaxSpins;
+inline constexpr int kSemaphoreLocks = kMaxSpins + 1;
+inline constexpr int kNumLockStatIds = kMaxSpins + 2;
+
+struct LockCounters {
+  u64 nacquires;   // Acquisitions, where known; see LockStats
+  u64 ncontended;  // Acquisitions that had to wait
+  u64 nspins;      // Spin iterations while waiting
+  u64 nsleeps;     // Sleeps while waiting
+  u64 wait_usec;   // Time spent waiting
+
+  LockCounters& operator+=(const LockCounters& rhs) {
+    nacquires += rhs.nacquires;
+    ncontended += rhs.ncontended;
+    nspins += rhs.nspins;
+    nsleeps += rhs.nsleeps;
+    wait_usec += rhs.wait_usec;
+
+    return *this;
+  }
+};
+
+enum class WaitEventType { kNone, kSpinLock, kSemaphore };
+
+// What a backend is blocked on, as seen from outside.
+struct WaitEvent {
+  WaitEventType type;
+  int lock_id;       // Id the wait is counted under
+  const void* lock;  // The lock instance, in the waiter's address space
+  u64 wait_usec;     // How long the wait has lasted so far
+};
+
+// Lock contention statistics and wait events, one slot per backend in the
+// main shared memory segment. Each backend only writes its own slot, with
+// relaxed atomic stores and no read-modify-write, so counting costs no more
+// than a few cache hits; anyone may read all the slots at any time.
+//
+// slock() counts every contended spinlock acquisition and
+// Semaphore::acquire() every semaphore wait, per id and per lock instance,
+// and both publish a wait event while they wait. A stuck spinlock thus shows
+// up as a wait event that keeps growing long before slock() gives up.
+// Uncontended acquisitions are only counted for the LockId table, by
+// SpinManager, and for SysV semaphores: counting them for every spinlock
+// would put a shared memory write on the S_LOCK() fast path.
+//
+// Up to kMaxInstances lock instances are tracked per backend; waits on more
+// are only counted per id.
+class LockStats {
+ public:
+  static constexpr int kMaxInstances = 64;
+
+  LockStats(ShmemAllocator* shmem, int max_backends);
+
+  // Count the locks of the calling thread in the slot of `backend_id`.
+  void attach(int backend_id);
+  static void detach();
+
+  static bool enabled() { return my_slot_ != nullptr; }
+
+  // Hooks for the lock implementations. They do nothing unless the calling
+  // thread is attached.
+  static void report_wait_start(WaitEventType type, int lock_id,
+                                const void* lock);
+  static void report_wait_end();
+  static void count_acquire(int lock_id, const void* lock);
+  static void count_wait(int lock_id, const void* lock, u64 nspins,
+                         u64 nsleeps, u64 wait_usec);
+
+  // Counters summed over all backends. `lock_id` -1 stands for
+  // kOtherSpinLocks.
+  LockCounters counters(int lock_id) const;
+  LockCounters instance_counters(const void* lock) const;
+
+  // Process attached to the slot of `backend_id`, 0 if none, and what it
+  // waits on.
+  pid_t pid(int backend_id) const;
+  WaitEvent wait_event(int backend_id) const;
+
+  int max_backends() const { return max_backends_; }
+  bool is_ok() const { return slots_ != nullptr; }
+
+ private:
+  struct BackendSlot;
+
+  static thread_local BackendSlot* my_slot_;
+
+  BackendSlot* slots_;
+  int max_backends_;
+};
+
+}  // namespace rdbms
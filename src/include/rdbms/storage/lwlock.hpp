@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+
+#include "rdbms/storage/sema.hpp"
+#include "rdbms/storage/shmem.hpp"
+#include "rdbms/storage/spin.hpp"
+
+namespace rdbms {
+
+enum class LWLockMode { kShared, kExclusive };
+
+// What a process needs to sleep on an LWLock. Each process sets up one in
+// shared memory and registers it with LWLock::set_my_waiter() before taking
+// any LWLock; threads of one process need one each. Waiters are linked by
+// address, which is the same in every process since the main segment is
+// mapped before the postmaster forks.
+struct LWLockWaiter {
+  FutexSemaphore sema;
+  std::atomic<bool> waiting{false};  // On a wait queue, not yet woken up
+  LWLockMode wait_mode = LWLockMode::kShared;
+  LWLockWaiter* next = nullptr;
+};
+
+// A lightweight lock in shared memory, held in shared or exclusive mode.
+// Readers of read-mostly structures such as the buffer mapping table and
+// the proc array hold it shared and never wait for each other.
+//
+// The whole lock state is one atomic word: the number of shared holders,
+// an exclusive bit, and flags for the wait queue. An uncontended acquire or
+// release is a single compare-and-swap or fetch-sub. A process that has to
+// wait queues itself and sleeps on the semaphore of its LWLockWaiter; the
+// releaser wakes up either the first waiter, if it wants the lock
+// exclusively, or every shared waiter in the queue. The queue is protected
+// by a bit of the state word rather than by a separate spinlock.
+//
+// Holding an LWLock holds off cancel/die interrupts, so keep it short; it is
+// not released on error.
+class LWLock {
+ public:
+  LWLock() : state_(kFlagReleaseOk), head_(nullptr), tail_(nullptr) {}
+
+  LWLock(const LWLock&) = delete;
+  LWLock& operator=(const LWLock&) = delete;
+
+  // Register the waiter of the calling thread.
+  static void set_my_waiter(LWLockWaiter* waiter);
+
+  // Acquire the lock in `mode`, sleeping as long as needed. Return true if
+  // the lock was free right away, false if we had to sleep.
+  bool acquire(LWLockMode mode);
+
+  // Acquire the lock in `mode` if that is possible without waiting.
+  bool try_acquire(LWLockMode mode);
+
+  // Release the lock, whichever mode it is held in.
+  void release();
+
+  bool held_exclusive() const {
+    return (state_.load(std::memory_order_relaxed) & kValExclusive) != 0;
+  }
+
+  u32 nshared() const {
+    return state_.load(std::memory_order_relaxed) & kSharedMask;
+  }
+
+ private:
+  static constexpr u32 kFlagHasWaiters = 1u << 30;
+  static constexpr u32 kFlagReleaseOk = 1u << 29;  // No wakeup in flight
+  static constexpr u32 kFlagLocked = 1u << 28;     // Wait queue is locked
+  static constexpr u32 kValExclusive = 1u << 24;
+  static constexpr u32 kValShared = 1;
+  static constexpr u32 kSharedMask = kValExclusive - 1;
+  static constexpr u32 kLockMask = kValExclusive | kSharedMask;
+
+  // Try to grab the lock. Return true if we must wait.
+  bool attempt_lock(LWLockMode mode);
+
+  void lock_wait_list();
+  void unlock_wait_list();
+
+  // Add/remove the calling thread to/from the wait queue.
+  void queue_self(LWLockMode mode);
+  void dequeue_self(int* extra_waits);
+
+  void wakeup();
+
+  std::atomic<u32> state_;
+  LWLockWaiter* head_;
+  LWLockWaiter* tail_;
+};
+
+// The LWLocks named in the LockId table, one per cache line, allocated in
+// the main shared memory segment.
+class LWLockManager {
+ public:
+  explicit LWLockManager(ShmemAllocator* shmem);
+
+  bool acquire(LockId lockid, LWLockMode mode) {
+    return lock(lockid)->acquire(mode);
+  }
+
+  bool try_acquire(LockId lockid, LWLockMode mode) {
+    return lock(lockid)->try_acquire(mode);
+  }
+
+  void release(LockId lockid) { lock(lockid)->release(); }
+
+  LWLock* lock(LockId lockid) { return &locks_[lockid].lock; }
+
+  bool is_ok() const { return locks_ != nullptr; }
+
+ private:
+  struct alignas(CACHE_LINE_SIZE) LWLockPadded {
+    LWLock lock;
+  };
+
+  static_assert(sizeof(LWLockPadded) == CACHE_LINE_SIZE);
+
+  LWLockPadded* locks_;
+};
+
+}  // namespace rdbms
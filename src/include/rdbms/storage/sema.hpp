@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+#include "rdbms/postgres.hpp"
+
+namespace rdbms {
+
+// A counting semaphore that lives in shared memory, an alternative to the
+// SysV Semaphore for lock waits on the commit path. The counter is a plain
+// atomic, so acquire() and release() stay in user space unless a process
+// actually has to sleep or wake another one; only then do they make a futex
+// system call. A SysV Semaphore pays a semop() for every operation, and each
+// set is capped at kMaxSema semaphores, while these cost 8 bytes apiece.
+//
+// Place it in memory shared by all processes using it, e.g. with
+// ShmemAllocator::init_struct(), and construct it once with placement new.
+// Platforms without futexes sleep in short naps while the counter is 0.
+class FutexSemaphore {
+ public:
+  explicit FutexSemaphore(u32 start_value = 0) : value_(start_value) {}
+
+  FutexSemaphore(const FutexSemaphore&) = delete;
+  FutexSemaphore& operator=(const FutexSemaphore&) = delete;
+
+  // Atomically decrements the internal counter by 1 if it is greater than 0;
+  // otherwise blocks until it is greater than 0 and can successfully decrement
+  // the internal counter. Interrupts are checked as in Semaphore::acquire().
+  void acquire(bool interrupt_ok);
+
+  // Tries to atomically decrement the internal counter by 1 if it is greater
+  // than 0; no blocking occurs regardless.
+  bool try_acquire();
+
+  // Atomically increments the internal counter by the value of update, and
+  // wakes up as many sleeping acquirers.
+  void release(std::ptrdiff_t update = 1);
+
+  u32 value() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+  // The kernel reads the counter as a plain 32-bit integer.
+  static_assert(sizeof(std::atomic<u32>) == sizeof(u32));
+  static_assert(std::atomic<u32>::is_always_lock_free);
+
+  std::atomic<u32> value_;
+  std::atomic<u32> nwaiters_{0};
+};
+
+}  // namespace rdbms
@@ -1,19 +1,84 @@
 #pragma once
 
 #include "rdbms/storage/ipc.hpp"
-#include "rdbms/utils/hsearch.hpp"
+#include "rdbms/storage/slock.hpp"
 
 namespace rdbms {
 
+// An entry of the ShmemIndex, which maps the name of a structure in shared
+// memory to its location. Offsets are relative to the start of the segment,
+// so the index stays valid wherever a process maps the segment.
+struct ShmemIndexEnt {
+  static constexpr int kKeySize = 48;
+
+  char key[kKeySize];  // Name of the structure, NUL-terminated
+  Size offset;         // Offset of the structure, 0 while unused
+  Size size;           // Size of the structure
+};
+
+// ShmemAllocator carves the shared memory segment into the structures that
+// all backends share: lock tables, buffer descriptors and the like. Space is
+// never given back; it lives as long as the segment.
+//
+// Allocation is a compare-and-swap on the segment header's `free_offset`,
+// so backends setting up their structures at startup don't serialize on a
+// spinlock for every allocation. Each allocation is rounded up to whole cache
+// lines, which keeps structures updated by different backends from sharing a
+// line. A request that does not fit leaves `free_offset` alone, so smaller
+// ones can still be served from what is left.
+//
+// Structures that backends look up by name are registered in the ShmemIndex,
+// a fixed-size open addressing table at the start of the segment. It is
+// protected by a spinlock of its own, which is only taken to look up or
+// register a name.
 class ShmemAllocator {
  public:
-  // Allocate max-aligned chunk from shared memory.
-  // Assumes ShmemLock and ShmemSegHdr are initialized.
-  //
+  static constexpr int kShmemIndexSize = 128;
+
+  ShmemAllocator(Size size, int permission, bool is_private = false);
+
+  // Allocate a cache-line aligned chunk from shared memory. Return nullptr if
+  // the segment is exhausted.
   void* alloc(Size size);
 
+  // Attach to the structure named `name`, or allocate and register it if it
+  // does not exist yet. `found` tells which happened; the creator is
+  // expected to initialize the structure. Return nullptr if the segment or
+  // the index is full, or if the structure exists with a different size.
+  void* init_struct(const char* name, Size size, bool* found);
+
+  // Whether `ptr` points into the allocated part of the segment.
+  bool is_valid(const void* ptr) const;
+
+  // Bytes left for allocation.
+  Size available() const;
+
+  Size total_size() const { return shared_mem_.shmaddr_->total_size; }
+
+  // Whether the segment was set up along with its index. The constructor
+  // fails if the segment is too small to hold the index, and init_struct()
+  // refuses to run then.
+  bool is_ok() const {
+    return shared_mem_.is_ok() && shared_mem_.shmaddr_->index_offset != 0;
+  }
+
  private:
+  struct ShmemIndexData {
+    LwLock lock;
+    int nentries;
+    ShmemIndexEnt entries[kShmemIndexSize];
+  };
+
+  Pointer base() const {
+    return reinterpret_cast<Pointer>(shared_mem_.shmaddr_);
+  }
+
+  ShmemIndexData* index() const {
+    return reinterpret_cast<ShmemIndexData*>(
+        base() + shared_mem_.shmaddr_->index_offset);
+  }
+
   SharedMemory shared_mem_;
 };
 
-}  // namespace rdbms
\ No newline at end of file
+}  // namespace rdbms
@@ -5,6 +5,8 @@
 #include <mutex>
 #include <thread>
 
+#include "rdbms/c.hpp"
+
 namespace rdbms {
 
 #define S_LOCK(lock)                     \
@@ -14,7 +16,7 @@ namespace rdbms {
     }                                    \
   } while (0)
 
-#define S_UNLOCK(lock)    (*(lock) = 0)
+#define S_UNLOCK(lock)    __atomic_store_n((lock), 0, __ATOMIC_RELEASE)
 #define S_LOCK_FREE(lock) (*(lock) = 0)
 #define S_LOCK_INIT(lock) S_UNLOCK(lock)
 
@@ -34,12 +36,20 @@ static inline int tas(LwLock* lock) {
       "lock\n"
       "xchg %0, %1\n"
       : "=q"(res), "=m"(*lock)
-      : "0"(res));
+      : "0"(res)
+      : "memory");
 
   return res;
 }
 
-void slock(LwLock* lock, const char* filename, int lineno);
+// Wait for `lock` after tas() failed, and take it. Return the number of
+// times we slept. The wait is counted in LockStats under `lock_id`, a
+// LockId, or -1 for a lock without one.
+unsigned int slock(LwLock* lock, const char* filename, int lineno,
+                   int lock_id = -1);
+
+// How many times slock() currently spins before it sleeps.
+int spins_per_delay();
 
 class TasLock {
  public:
@@ -47,8 +57,8 @@ class TasLock {
 
   TasLock() { S_LOCK_INIT(&lock_); }
 
-  constexpr void acquire() { S_LOCK(&lock_); }
-  constexpr void release() { S_UNLOCK(&lock_); }
+  void acquire() { S_LOCK(&lock_); }
+  void release() { S_UNLOCK(&lock_); }
 
  private:
   LwLock lock_;
@@ -58,8 +68,8 @@ class MutexLock {
  public:
   static const char* name() { return "MutexLock"; }
 
-  constexpr void acquire() { mtx_.lock(); }
-  constexpr void release() { mtx_.unlock(); }
+  void acquire() { mtx_.lock(); }
+  void release() { mtx_.unlock(); }
 
  private:
   std::mutex mtx_;
@@ -71,16 +81,55 @@ class AtomicLock {
 
   AtomicLock() {}
 
-  constexpr void acquire() {
+  void acquire() {
     while (flag_.test_and_set(std::memory_order_acquire)) {
       std::this_thread::sleep_for(std::chrono::seconds(1));
     }
   }
 
-  constexpr void release() { flag_.clear(std::memory_order_release); }
+  void release() { flag_.clear(std::memory_order_release); }
 
  private:
   std::atomic_flag flag_ = ATOMIC_FLAG_INIT;
 };
 
+// Queued spinlock after Mellor-Crummey and Scott. The locks above have every
+// waiter spin on the lock word, so each acquire and release bounces its cache
+// line between all waiting CPUs. Here waiters line up in a queue, each
+// spinning on a node of its own cache line, and the holder hands the lock to
+// the next waiter by writing to that waiter's node alone. Waiters get the
+// lock in arrival order.
+//
+// Nodes come from a per-thread pool, so a thread may hold several McsLocks
+// at once. The lock is meant for threads of one process: nodes are linked by
+// address. A waiter spins for a while and then yields its CPU, which keeps
+// a lock handed to a descheduled waiter from stalling the others for a whole
+// time slice.
+class McsLock {
+ public:
+  static const char* name() { return "McsLock"; }
+
+  McsLock() : tail_(nullptr), holder_(nullptr) {}
+
+  McsLock(const McsLock&) = delete;
+  McsLock& operator=(const McsLock&) = delete;
+
+  void acquire();
+  void release();
+
+ private:
+  struct alignas(CACHE_LINE_SIZE) Node {
+    std::atomic<Node*> next;
+    std::atomic<bool> locked;
+    Node* free_next;  // Link in the per-thread pool
+  };
+
+  static Node*& free_nodes();
+  static Node* get_node();
+  static void put_node(Node* node);
+
+  alignas(CACHE_LINE_SIZE) std::atomic<Node*> tail_;
+  Node* holder_;  // Node of the holder, only used by the holder
+};
+
 }  // namespace rdbms
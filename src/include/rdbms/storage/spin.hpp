@@ -1,6 +1,9 @@
 #pragma once
 
+#include <atomic>
+
 #include "rdbms/storage/ipc.hpp"
+#include "rdbms/storage/shmem.hpp"
 #include "rdbms/storage/slock.hpp"
 
 namespace rdbms {
@@ -20,14 +23,38 @@ enum LockId {
   kMaxSpins
 };
 
+struct SpinLockStats {
+  u64 nacquires;  // Times the lock was acquired
+  u64 ndelays;    // Times an acquirer had to sleep because it was taken
+};
+
+// The spinlocks named in the LockId table, allocated in the main shared
+// memory segment. Each lock has a cache line to itself, along with its
+// counters: packed locks would false-share, so that taking kBufMgrLockId
+// would steal the line of kXidGenLockId from whoever is about to take it.
+// The counters are only updated by the holder of the lock, which owns the
+// line anyway, so keeping them costs no extra cache misses.
 class SpinManager {
  public:
-  SpinManager();
+  explicit SpinManager(ShmemAllocator* shmem);
 
   void acquire(LockId lockid);
   void release(LockId lockid);
 
+  SpinLockStats stats(LockId lockid) const;
+
+  bool is_ok() const { return slots_ != nullptr; }
+
  private:
+  struct alignas(CACHE_LINE_SIZE) SpinSlot {
+    SpinLock lock;
+    std::atomic<u64> nacquires;
+    std::atomic<u64> ndelays;
+  };
+
+  static_assert(sizeof(SpinSlot) == CACHE_LINE_SIZE);
+
+  SpinSlot* slots_;
 };
 
-}  // namespace rdbms
\ No newline at end of file
+}  // namespace rdbms
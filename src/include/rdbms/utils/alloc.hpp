@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+
 #include "rdbms/postgres.hpp"
 
 namespace rdbms {
@@ -9,21 +11,99 @@ struct Memory {
   Size size;
 };
 
+// Counters of the block cache in front of malloc, see MemoryPool.
+struct BlockCacheStats {
+  Size hits;           // Allocations served from the cache
+  Size misses;         // Allocations that had to go to malloc
+  Size trims;          // Cached blocks handed back to free
+  Size cached_blocks;  // Blocks currently parked in the cache
+  Size cached_bytes;   // Bytes currently parked in the cache
+};
+
+// Huge pages backing blocks from MemoryPool::allocate_huge().
+struct HugePageStats {
+  Size hugetlb_pages;      // Reserved huge pages mapped with MAP_HUGETLB
+  Size madvised_pages;     // Huge page sized ranges left to THP, see below
+  Size hugetlb_fallbacks;  // Times THP was used instead of MAP_HUGETLB
+};
+
 // A simple memory wrapper for malloc and free.
 // The reason to add this:
 // 1. Add some protection when memory allocation failed.
 // 2. This allocator could be replaced in the future.
+//
+// Freed blocks between kMinCachedSize and the cache limit are not returned to
+// libc right away. They are parked in a per-thread cache, bucketed by the
+// power-of-2 size class of their capacity, and handed out again to the next
+// allocation that fits. Memory contexts are reset and destroyed once per
+// query, so this turns most of the malloc/free churn of short queries into a
+// list operation.
+//
+// The cache is bounded twice: each size class holds at most
+// `max_blocks_per_class` blocks, and all classes together at most `max_bytes`.
+// When a free would exceed either bound, the cache is trimmed, largest size
+// classes and least recently freed blocks first: big blocks tie up the most
+// memory, while the small ones are what OLTP workloads keep asking for.
+//
+// A block served from the cache may be larger than requested; the returned
+// Memory reports the full capacity.
+//
+// Every thread counts the bytes it allocates and frees in a counter of its
+// own, which bytes_allocated() sums up on demand. Blocks may be freed by
+// another thread than the one that allocated them, so a single thread's
+// count can go negative.
+//
+// allocate_huge() serves blocks of at least huge_page_threshold() bytes from
+// huge pages, which cuts the TLB misses of scanning big hash tables and sort
+// arrays. It maps reserved huge pages with MAP_HUGETLB and, if none are
+// available, falls back to regular pages aligned to the huge page size and
+// madvise(MADV_HUGEPAGE). The kernel may or may not back the latter with
+// transparent huge pages, so they are counted separately. After MAP_HUGETLB
+// fails once, it is not tried again until a MAP_HUGETLB block is released.
+// Such blocks are rounded up to whole huge pages, reported as capacity, and
+// never cached.
 class MemoryPool {
  public:
-  static Memory allocate(Size nbytes);
+  static constexpr Size kMinCachedSize = 1024;
+  static constexpr Size kDefaultCacheBytes = 32 * 1024 * 1024;
+  static constexpr Size kDefaultCacheBlocksPerClass = 32;
+
+  // A cached block handed out is at most `max_capacity` bytes big.
+  static Memory allocate(Size nbytes, Size max_capacity = ~Size{0});
+  static Memory allocate_huge(Size nbytes, Size max_capacity = ~Size{0});
   static Memory reallocate(void* ptr, Size nbytes);
   static void deallocate(void* ptr);
-  static Size bytes_allocated() { return bytes_allocated_; }
+
+  // Capacity of a block returned by allocate() or reallocate().
+  static Size capacity(const void* ptr);
+
+  static Size huge_page_size();
+
+  // Smaller blocks are taken from malloc() by allocate_huge(), too. Defaults
+  // to the huge page size; 0 restores the default.
+  static void set_huge_page_threshold(Size nbytes);
+  static Size huge_page_threshold();
+
+  static HugePageStats huge_page_stats();
+
+  // Bytes currently allocated by all threads together.
+  static Size bytes_allocated();
+
+  // Bytes allocated minus bytes freed by the calling thread.
+  static std::int64_t thread_bytes_allocated();
+
+  // Change the bounds of the calling thread's block cache, trimming it right
+  // away if it holds more than the new bounds allow. A `max_bytes` of 0
+  // disables caching.
+  static void set_cache_limits(Size max_bytes, Size max_blocks_per_class);
+
+  // Return every cached block of the calling thread to libc.
+  static void trim_cache();
+
+  static BlockCacheStats cache_stats();
 
  private:
   static Size recommend_size(Size nbytes);
-
-  static Size bytes_allocated_;
 };
 
-}  // namespace rdbms
\ No newline at end of file
+}  // namespace rdbms
@@ -1,5 +1,11 @@
 #pragma once
 
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <new>
+
 #include "rdbms/utils/alloc.hpp"
 #include "rdbms/utils/mcxt.hpp"
 
@@ -10,6 +16,46 @@ using AllocBlock = struct AllocBlockData*;
 using AllocChunk = struct AllocChunkData*;
 using ConstAllocBlock = const struct AllocBlockData*;
 
+// Each chunk consists of header and data. The header holds a single word,
+// which is also the chunk's owner word (see MemoryContextData):
+//
+//   bits 0-1   MemoryContextData::kEncodedTag
+//   bit  2     set while the chunk is on a freelist
+//   bits 3-6   freelist index, or kLargeIndex for a chunk with its own block
+//   bits 7-63  distance from the word back to the start of its block
+//
+// The size of a chunk follows from its freelist index, or from the end of its
+// block for a large chunk, and the block leads to the aset. A free chunk keeps
+// its header and links to the next free chunk through its data area. Note
+// that: chunk doesn't own the data. The caller should be responsible for
+// cleaning the data.
+//
+// The word is padded in front to MAXIMUM_ALIGNOF, so the data stays
+// max-aligned. With MEMORY_CONTEXT_CHECKING the padding records the requested
+// size, which can be smaller than the chunk, to detect writes past it.
+struct AllocChunkHeader {
+#if MEMORY_CONTEXT_CHECKING
+  Size requested_size;  // Size asked for, 0 while the chunk is free
+#else
+  Size padding;
+#endif
+  std::uint64_t word;  // Encoded as above, must come last
+};
+
+struct AllocBlockHeader {
+ public:
+  AllocBlockHeader(AllocSet aset, Memory mem);
+
+  AllocSet aset;      // aset that owns this block
+  Pointer free_ptr;   // Start of free space in this block
+  Pointer end_ptr;    // End of space in this block
+  AllocBlock prev{};  // Previous block in aset's blocks list
+  AllocBlock next{};  // Next block in aset's blocks list
+};
+
+// HeaderBase is overlaid on the start of a chunk or block: the header lives
+// at the beginning of the memory and the data begins at the next alignment
+// boundary after it.
 template <typename T>
 struct HeaderBase {
  public:
@@ -19,55 +65,36 @@ struct HeaderBase {
   using reference = value_type&;
   using const_referene = const value_type&;
 
-  static constexpr Size kMinSize = MAX_ALIGN(kHdrSize);
-
-  reference header() {
-    void* base = static_cast<Pointer>(data_) - kMinSize;
-    return *static_cast<pointer>(base);
-  }
+  static constexpr Size kMinSize = MAX_ALIGN(sizeof(T));
 
-  const_referene header() const {
-    const void* base = static_cast<Pointer>(data_) - kMinSize;
+  reference header() { return header_; }
+  const_referene header() const { return header_; }
 
-    return *static_cast<const_pointer>(base);
-  }
-
-  const void* data() const { return data_; }
-  void* data() { return data_; }
+  const void* data() const { return base() + kMinSize; }
+  void* data() { return const_cast<Pointer>(base()) + kMinSize; }
 
  protected:
-  HeaderBase(const T& header, Memory mem) {
-    assert(mem.size >= kMinSize);
-
-    std::memcpy(mem.ptr, std::addressof(header), kHdrSize);
-    data_ = static_cast<Pointer>(mem.ptr) + kMinSize;
-  }
+  explicit HeaderBase(const T& header) : header_(header) {}
 
-  ConstPointer base() const { return static_cast<Pointer>(data_) - kMinSize; }
+  ConstPointer base() const { return reinterpret_cast<ConstPointer>(this); }
 
  private:
-  static constexpr Size kHdrSize = sizeof(T);
-
-  void* data_;
+  T header_;
 };
 
 static inline constexpr int kChunkHdrSz =
     HeaderBase<AllocChunkHeader>::kMinSize;
 
+// The owner word must immediately precede the data.
+static_assert(kChunkHdrSz == sizeof(AllocChunkHeader));
+
 static inline constexpr int kBlockHdrSz =
     HeaderBase<AllocBlockHeader>::kMinSize;
 
-// Each chunk consists of header and data. The header keeps track of allocated
-// memory size and requested size. The actual allocated size may be greater than
-// the requested size when taking the alignment into consideration. The `next`
-// field could be next chunk when this chunk is inisde the free list or block
-// when it's used for the client. Note that: chunk doesn't own the data. The
-// caller should be responsible for cleaning the data.
-struct AllocChunkHeader {
-  void* next;
-  Size size;
-  Size requested_size;
-};
+inline AllocBlockHeader::AllocBlockHeader(AllocSet aset, Memory mem)
+    : aset(aset),
+      free_ptr(static_cast<Pointer>(mem.ptr) + kBlockHdrSz),
+      end_ptr(static_cast<Pointer>(mem.ptr) + mem.size) {}
 
 // Chunk freelist k holds chunks of size 1 << (k + ALLOC_MINBITS),
 // for k = 0 .. ALLOCSET_NUM_FREELISTS-1.
@@ -81,10 +108,9 @@ struct AllocChunkHeader {
 // chunk header, but when the chunk is freed we'll return the whole block
 // to malloc(), not put it on our freelists.
 //
-// CAUTION: ALLOC_MINBITS must be large enough so that
-// 1<<ALLOC_MINBITS is at least MAXALIGN,
-// or we may fail to align the smallest chunks adequately.
-// 16-byte alignment is enough on all currently known machines.
+// CAUTION: kMinBits must be large enough that 1 << kMinBits is at least
+// MAXIMUM_ALIGNOF, or we may fail to align the smallest chunks adequately.
+// alignof(max_align_t) is 16 bytes on all currently known machines.
 //
 // With the current parameters, request sizes up to 8K are treated as chunks,
 // larger requests go into dedicated blocks.  Change ALLOCSET_NUM_FREELISTS
@@ -96,6 +122,7 @@ struct AllocChunkData : public HeaderBase<AllocChunkHeader> {
 
   static constexpr int kMagic = 0x7E;
   static constexpr int kDirty = 0x7F;
+  static constexpr int kLargeIndex = 0xF;
 
   // This function is invoked when the client frees the chunk.
   // It serves to cast the pointer back to its original chunk type.
@@ -104,36 +131,90 @@ struct AllocChunkData : public HeaderBase<AllocChunkHeader> {
                                         kChunkHdrSz);
   }
 
-  // Constructor.
-  AllocChunkData(Memory mem, void* next, Size requested_size)
-      : Base({next, mem.size, requested_size}, mem) {}
+  // Constructor. The chunk is constructed in place in `block`, free, with
+  // freelist index `fidx`.
+  AllocChunkData(AllocBlock block, int fidx) : Base({}) {
+    auto offset = reinterpret_cast<Pointer>(&header().word) -
+                  reinterpret_cast<Pointer>(block);
 
-  AllocChunk next() { return static_cast<AllocChunk>(this->header().next); }
-  Size size() const { return this->header().size; }
-  Size requested_size() const { return header().requested_size; }
+    header().word = (offset << MemoryContextData::kOffsetShift) |
+                    (static_cast<std::uint64_t>(fidx) << kIndexShift) |
+                    kFreeBit | MemoryContextData::kEncodedTag;
+  }
 
-  void set_next(void* next) { this->header().next = next; }
-  void set_requested_size(Size requested_size) {
-    this->header().requested_size = requested_size;
-    this->mark_memory_boundary(requested_size);
+  AllocBlock block() const {
+    auto word_ptr = reinterpret_cast<ConstPointer>(&header().word);
+
+    return reinterpret_cast<AllocBlock>(const_cast<Pointer>(
+        word_ptr - (header().word >> MemoryContextData::kOffsetShift)));
+  }
+
+  inline AllocSet aset() const;
+
+  int free_index() const { return (header().word >> kIndexShift) & 0xF; }
+  bool is_large() const { return free_index() == kLargeIndex; }
+  bool is_free() const { return header().word & kFreeBit; }
+
+  // Move the chunk to another freelist after it grew or shrank in place.
+  void set_free_index(int fidx) {
+    header().word = (header().word & ~(std::uint64_t{0xF} << kIndexShift)) |
+                    (static_cast<std::uint64_t>(fidx) << kIndexShift);
+  }
+
+  inline Size size() const;
+
+  // Next chunk on the same freelist. Only valid while the chunk is free.
+  AllocChunk next_free() { return *static_cast<AllocChunk*>(data()); }
+  void set_next_free(AllocChunk next) {
+    *static_cast<AllocChunk*>(data()) = next;
+  }
+
+  // Hand the chunk out for a request of `requested_size` bytes.
+  void mark_allocated(Size requested_size) {
+    header().word &= ~kFreeBit;
+    set_requested_size(requested_size);
   }
 
-  // Marking this chunk as cleared signifies that it has been freed and is
-  // likely to be reintroduced into the freelist.
-  void clear() {
+  // Marking this chunk as free signifies that it is about to be put on a
+  // freelist.
+  void mark_free() {
+    header().word |= kFreeBit;
     set_requested_size(0);
+
+#if MEMORY_CONTEXT_CHECKING
     clobber_memory();
+#endif
+  }
+
+  // Record the size the client asked for. A no-op unless
+  // MEMORY_CONTEXT_CHECKING is on.
+  void set_requested_size([[maybe_unused]] Size requested_size) {
+#if MEMORY_CONTEXT_CHECKING
+    this->header().requested_size = requested_size;
+    this->mark_memory_boundary(requested_size);
+#endif
   }
 
+#if MEMORY_CONTEXT_CHECKING
+  Size requested_size() const { return header().requested_size; }
+#endif
+
+  // Always true unless MEMORY_CONTEXT_CHECKING is on.
   bool memory_boundary_check() const {
-    if (auto& hdr = this->header(); hdr.requested_size < hdr.size) {
-      return static_cast<ConstPointer>(data())[hdr.requested_size] == kMagic;
+#if MEMORY_CONTEXT_CHECKING
+    if (Size requested_size = header().requested_size; requested_size < size()) {
+      return static_cast<ConstPointer>(data())[requested_size] == kMagic;
     }
+#endif
 
     return true;
   }
 
  private:
+  static constexpr std::uint64_t kFreeBit = 1 << 2;
+  static constexpr int kIndexShift = 3;
+
+#if MEMORY_CONTEXT_CHECKING
   void mark_memory_boundary(Size requested_size) {
     if (requested_size < this->size()) {
       static_cast<Pointer>(data())[requested_size] = kMagic;
@@ -146,21 +227,7 @@ struct AllocChunkData : public HeaderBase<AllocChunkHeader> {
   // attempts to reuse the previously freed memory, the behavior becomes
   // undefined.
   void clobber_memory() { std::memset(data(), kDirty, size()); }
-};
-
-struct AllocBlockHeader {
- public:
-  using self = AllocBlockHeader;
-
-  AllocBlockHeader(AllocSet aset, Memory mem)
-      : aset(aset),
-        free_ptr(static_cast<Pointer>(mem.ptr) + HeaderBase<self>::kMinSize),
-        end_ptr(static_cast<Pointer>(mem.ptr) + mem.size) {}
-
-  AllocSet aset;      // aset that owns this block
-  Pointer free_ptr;   // Start of free space in this block
-  Pointer end_ptr;    // End of space in this block
-  AllocBlock next{};  // Next block in aset's blocks list
+#endif
 };
 
 // An AllocBlock is the unit of memory that is obtained by aset.c
@@ -176,12 +243,14 @@ struct AllocBlockData : public HeaderBase<AllocBlockHeader> {
  public:
   using Base = HeaderBase<AllocBlockHeader>;
 
-  explicit AllocBlockData(AllocSet aset, Memory mem) : Base({aset, mem}, mem) {}
+  // Constructor. The block is constructed in place at `mem.ptr`.
+  explicit AllocBlockData(AllocSet aset, Memory mem) : Base({aset, mem}) {}
 
   Pointer free_ptr() { return this->header().free_ptr; }
   ConstPointer free_ptr() const { return this->header().free_ptr; }
   Pointer end_ptr() { return this->header().end_ptr; }
   ConstPointer end_ptr() const { return this->header().end_ptr; }
+  AllocBlock prev() { return this->header().prev; }
   AllocBlock next() { return this->header().next; }
   AllocSet aset() { return this->header().aset; }
   Size size() const { return end_ptr() - base(); }
@@ -191,6 +260,7 @@ struct AllocBlockData : public HeaderBase<AllocBlockHeader> {
 
   void set_free_ptr(Pointer ptr) { this->header().free_ptr = ptr; }
   void set_end_ptr(Pointer ptr) { this->header().end_ptr = ptr; }
+  void set_prev(AllocBlock prev) { this->header().prev = prev; }
   void set_next(AllocBlock next) { this->header().next = next; }
 
   //  This function performs a memory integrity check by verifying that each
@@ -200,29 +270,21 @@ struct AllocBlockData : public HeaderBase<AllocBlockHeader> {
   // The reset operation reverts the free pointer to its initial position.
   void reset() {
     set_free_ptr(static_cast<Pointer>(data()));
+    set_prev(nullptr);
     set_next(nullptr);
   }
 
-  // Fetch one chunk with the specified chunk size from this block.
-  AllocChunk fetch_chunk(Size chunk_size, Size requested_size) {
-    Size required_size = kChunkHdrSz + chunk_size;
-
-    if (avail_space() < required_size) {
-      return nullptr;
-    }
+  // Fetch one chunk from freelist `fidx` from this block, or return nullptr
+  // if there is not enough room left.
+  inline AllocChunk fetch_chunk(int fidx, Size requested_size);
 
-    Pointer ptr = free_ptr();
-    Memory mem{ptr, chunk_size};
-
-    auto chunk = ::new (AllocChunkData)(mem, aset(), requested_size);
-    chunk->set_requested_size(requested_size);
-
-    set_free_ptr(ptr + required_size);
-
-    return chunk;
-  }
+  // Turn all the remaining space of this block into a single large chunk.
+  inline AllocChunk fetch_large_chunk(Size requested_size);
 };
 
+// A doubly linked list of blocks. Every block records its neighbours, so a
+// block can be unlinked in constant time, which matters when an aset holds
+// thousands of dedicated blocks for large chunks.
 struct LinkedBlock {
  public:
   using value_type = AllocBlock;
@@ -236,39 +298,45 @@ struct LinkedBlock {
   // greater than that of the current head, it will become the new head.
   // Otherwise, it will be placed after the current head.
   void enqueue(AllocBlock block) {
-    if (head_ == nullptr) {
-      head_ = block;
+    if (head_ == nullptr || block->avail_space() > head_->avail_space()) {
+      push_front(block);
     } else {
-      if (block->avail_space() > head_->avail_space()) {
-        block->set_next(head_);
-        head_ = block;
-      } else {
-        block->set_next(head_->next());
-        head_->set_next(block);
-      }
+      insert_after(head_, block);
     }
+  }
 
+  // Make the provided block the new head.
+  void push_front(AllocBlock block) {
+    block->set_prev(nullptr);
+    block->set_next(head_);
+
+    if (head_ != nullptr) {
+      head_->set_prev(block);
+    }
+
+    head_ = block;
     size_++;
   }
 
-  // Remove the specified block and return true if succeed to remove.
-  // Otherwise return false.
-  bool remove(void* block) {
-    AllocBlock prev = nullptr;
-    AllocBlock curr = head();
-
-    while (curr != nullptr) {
-      if (curr == block) {
-        remove(prev, curr);
+  // Unlink the specified block, which must be on this list.
+  void remove(AllocBlock block) {
+    AllocBlock prev = block->prev();
+    AllocBlock next = block->next();
 
-        return true;
-      }
+    if (prev == nullptr) {
+      assert(head_ == block);
+      head_ = next;
+    } else {
+      prev->set_next(next);
+    }
 
-      prev = curr;
-      curr = curr->next();
+    if (next != nullptr) {
+      next->set_prev(prev);
     }
 
-    return false;
+    block->set_prev(nullptr);
+    block->set_next(nullptr);
+    size_--;
   }
 
   void reset() {
@@ -276,20 +344,46 @@ struct LinkedBlock {
     size_ = 0;
   }
 
+  // Sort the blocks by size, largest first. This is a merge sort over the
+  // links, so it allocates nothing and is stable.
+  void sort_by_size() {
+    for (Size width = 1; width < size_; width *= 2) {
+      AllocBlock rest = head_;
+      AllocBlock* tail = &head_;
+
+      while (rest != nullptr) {
+        AllocBlock lhs = rest;
+        AllocBlock rhs = split(lhs, width);
+        rest = split(rhs, width);
+        tail = merge(lhs, rhs, tail);
+      }
+    }
+
+    AllocBlock prev = nullptr;
+
+    for (AllocBlock block = head_; block != nullptr; block = block->next()) {
+      block->set_prev(prev);
+      prev = block;
+    }
+  }
+
   struct Iterator {
    public:
     Iterator operator++(int) {
       assert(block_ != nullptr);
 
-      return {block_->next()};
+      Iterator old = *this;
+      block_ = block_->next();
+
+      return old;
     }
 
-    Iterator operator++() {
+    Iterator& operator++() {
       assert(block_ != nullptr);
 
       block_ = block_->next();
 
-      return {block_};
+      return *this;
     }
 
     value_type operator*() { return block_; }
@@ -303,7 +397,7 @@ struct LinkedBlock {
     }
 
    private:
-    friend class LinkedBlock;
+    friend struct LinkedBlock;
 
     Iterator(value_type block) : block_(block) {}
 
@@ -314,22 +408,74 @@ struct LinkedBlock {
   Iterator end() { return {nullptr}; }
 
  private:
-  void remove(AllocBlock prev, AllocBlock target) {
-    AllocBlock next = target->next();
+  void insert_after(AllocBlock prev, AllocBlock block) {
+    AllocBlock next = prev->next();
 
-    if (prev == nullptr) {
-      head_ = next;
-    } else {
-      prev->set_next(next);
+    block->set_prev(prev);
+    block->set_next(next);
+    prev->set_next(block);
+
+    if (next != nullptr) {
+      next->set_prev(block);
     }
 
-    size_--;
+    size_++;
+  }
+
+  // Cut the run starting at `block` after `n` blocks and return the rest.
+  static AllocBlock split(AllocBlock block, Size n) {
+    for (Size i = 1; block != nullptr && i < n; i++) {
+      block = block->next();
+    }
+
+    if (block == nullptr) {
+      return nullptr;
+    }
+
+    AllocBlock rest = block->next();
+    block->set_next(nullptr);
+
+    return rest;
   }
 
-  AllocBlock head_;
+  // Merge two sorted runs into the link `tail` and return the link after the
+  // last block.
+  static AllocBlock* merge(AllocBlock lhs, AllocBlock rhs, AllocBlock* tail) {
+    while (lhs != nullptr && rhs != nullptr) {
+      if (lhs->size() >= rhs->size()) {
+        *tail = lhs;
+        lhs = lhs->next();
+      } else {
+        *tail = rhs;
+        rhs = rhs->next();
+      }
+
+      tail = &(*tail)->header().next;
+    }
+
+    *tail = lhs != nullptr ? lhs : rhs;
+
+    while (*tail != nullptr) {
+      tail = &(*tail)->header().next;
+    }
+
+    return tail;
+  }
+
+  AllocBlock head_{};
   Size size_{};
 };
 
+// Counters of the blocks an AllocSetContext retains across resets, see
+// AllocSetContext::set_retained_limit().
+struct BlockRetentionStats {
+  Size resets;          // Calls to reset()
+  Size clean_resets;    // Resets that released no block to MemoryPool
+  Size reused_blocks;   // Blocks taken from the retained ones
+  Size new_blocks;      // Blocks that had to come from MemoryPool
+  Size retained_bytes;  // Bytes currently retained
+};
+
 class AllocSetContext : public MemoryContextData {
  public:
   static constexpr int kMinBits = 4;  // Smallest chunk size is 16 bytes
@@ -337,6 +483,8 @@ class AllocSetContext : public MemoryContextData {
   static constexpr int kChunkLimit = (1 << (kNumFreeLists - 1 + kMinBits));
   static constexpr Size kMinBlockSize = 1024;
 
+  static_assert((1 << kMinBits) >= MAXIMUM_ALIGNOF);
+
   AllocSetContext(MemoryContext parent, std::string name, Size min_context_size,
                   Size init_block_size, Size max_block_size);
 
@@ -352,39 +500,120 @@ class AllocSetContext : public MemoryContextData {
   // find yourself in an infinite loop when trouble occurs, because this
   // routine will be entered again when elog cleanup tries to release memory!
   void check() override;
-  void stats() override;
+  void count(MemoryContextCounters* counters) override;
 
- private:
-  static int free_index(Size size) {
-    int index = 0;
+  // Keep up to `nbytes` of blocks across reset(), besides the keeper block,
+  // largest blocks first. Per-tuple and per-query contexts are reset over and
+  // over, and usually need the same blocks every time, so retaining them
+  // saves a round trip to MemoryPool per block and reset. Defaults to 0.
+  void set_retained_limit(Size nbytes) { retained_limit_ = nbytes; }
+  Size retained_limit() const { return retained_limit_; }
 
-    if (size > 0) {
-      size = (size - 1) >> kMinBits;
+  BlockRetentionStats retention_stats() const;
 
-      while (size != 0) {
-        index++;
-        size >>= 1;
+  // Inline fast path of alloc() for chunks up to kChunkLimit, used by
+  // palloc(): pop the matching freelist, or carve a chunk off the head block
+  // if it has room. Return nullptr if neither works, in which case the
+  // caller falls back to alloc().
+  void* alloc_small(Size size) {
+    assert(size <= kChunkLimit);
+
+    int fidx = free_index(size);
+
+    // All chunks on a freelist have the same size, so the first one fits.
+    if (AllocChunk chunk = freelist_[fidx]; chunk != nullptr) {
+      freelist_[fidx] = chunk->next_free();
+      chunk->mark_allocated(size);
+
+      return profile_alloc(chunk->data(), size);
+    }
+
+    if (AllocBlock block = blocks_.head(); block != nullptr) {
+      if (AllocChunk chunk = block->fetch_chunk(fidx, size); chunk != nullptr) {
+        return profile_alloc(chunk->data(), size);
       }
+    }
+
+    return nullptr;
+  }
 
-      assert(index < kNumFreeLists);
+ private:
+  static int free_index(Size size) {
+    if (size == 0) {
+      return 0;
     }
 
+    int index = std::bit_width((size - 1) >> kMinBits);
+    assert(index < kNumFreeLists);
+
     return index;
   }
 
+  // alloc() without running the spill callbacks, for realloc(), which must
+  // copy the old chunk first.
+  void* alloc_chunk(Size size);
+
   AllocChunk alloc_large_chunk(Size size);
   AllocChunk try_alloc_from_freelist(Size size);
   AllocChunk alloc_from_block(Size size);
   void merge_block_remainder_to_chunk(AllocBlock block);
+  AllocBlock take_retained_block(Size required_size);
+
+  // Grow a small chunk to `size` bytes without moving it, which works if it
+  // is the last chunk carved from the active block and the block has room.
+  bool try_grow_in_place(AllocChunk chunk, Size size);
   void return_chunk_to_freelist(AllocChunk chunk);
 
   void free_large_chunk(AllocChunk chunk);
+  AllocBlock large_chunk_block(AllocChunk chunk);
 
   LinkedBlock blocks_;
-  AllocBlock keeper_;
+  LinkedBlock retained_;  // Empty blocks kept by reset(), largest first
+  AllocBlock keeper_;     // Block allocated up front, never released by reset()
   AllocChunk freelist_[kNumFreeLists];
   Size init_block_size_;
   Size max_block_size_;
+  Size retained_limit_{};
+  BlockRetentionStats retention_stats_{};
 };
 
-}  // namespace rdbms
\ No newline at end of file
+inline AllocSet AllocChunkData::aset() const { return block()->aset(); }
+
+inline Size AllocChunkData::size() const {
+  if (is_large()) {
+    return block()->end_ptr() - static_cast<ConstPointer>(data());
+  }
+
+  return Size{1} << (free_index() + AllocSetContext::kMinBits);
+}
+
+inline AllocChunk AllocBlockData::fetch_chunk(int fidx, Size requested_size) {
+  Size required_size =
+      kChunkHdrSz + (Size{1} << (fidx + AllocSetContext::kMinBits));
+
+  if (avail_space() < required_size) {
+    return nullptr;
+  }
+
+  Pointer ptr = free_ptr();
+  auto chunk = ::new (ptr) AllocChunkData(this, fidx);
+  chunk->mark_allocated(requested_size);
+
+  set_free_ptr(ptr + required_size);
+
+  return chunk;
+}
+
+inline AllocChunk AllocBlockData::fetch_large_chunk(Size requested_size) {
+  assert(avail_space() > static_cast<Size>(kChunkHdrSz));
+
+  Pointer ptr = free_ptr();
+  auto chunk = ::new (ptr) AllocChunkData(this, AllocChunkData::kLargeIndex);
+  chunk->mark_allocated(requested_size);
+
+  set_free_ptr(end_ptr());
+
+  return chunk;
+}
+
+}  // namespace rdbms
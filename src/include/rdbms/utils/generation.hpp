@@ -0,0 +1,112 @@
+#pragma once
+
+#include "rdbms/utils/alloc.hpp"
+#include "rdbms/utils/mcxt.hpp"
+
+namespace rdbms {
+
+using Generation = class GenerationContext*;
+using GenerationBlock = struct GenerationBlockData*;
+using GenerationChunk = struct GenerationChunkHeader*;
+
+// Each chunk is preceded by its size and the block it was carved from. The
+// block link doubles as the chunk's owner word, see MemoryContextData. It is
+// cleared when the chunk is freed, which lets check() tell live chunks from
+// dead ones.
+struct GenerationChunkHeader {
+  Size size;             // Usable size of the chunk
+  std::uintptr_t block;  // Tagged block that owns this chunk, 0 once freed
+};
+
+// A GenerationBlock is the unit of memory that generation.cc obtains from
+// MemoryPool. Chunks are bump-allocated from `free_ptr` and never reused
+// individually: the block only counts how many of its chunks are still
+// alive, and goes away as a whole once the last one is freed.
+struct GenerationBlockData {
+  Generation context;    // Generation context that owns this block
+  GenerationBlock prev;  // Previous block in the context's list
+  GenerationBlock next;  // Next block in the context's list
+  Size size;             // Total size of this block, header included
+  int nchunks;           // Number of chunks carved from this block
+  int nfree;             // Number of those chunks already freed
+  Size freed_bytes;      // Space of the freed chunks, headers included
+  Pointer free_ptr;      // Start of free space in this block
+  Pointer end_ptr;       // End of space in this block
+
+  Size avail_space() const { return end_ptr - free_ptr; }
+};
+
+// GenerationContext is a memory context for allocations that are freed in
+// roughly the order they were made, such as tuple stores and sort runs.
+//
+// AllocSetContext puts freed chunks on power-of-2 freelists which a FIFO
+// workload never asks for again, so memory fragments over the life of a
+// long query. A generation context does no per-chunk bookkeeping at all:
+// alloc() bumps a pointer in the current block and free() only decrements
+// the block's live chunk count. Once every chunk in a block is freed, the
+// whole block is released, which keeps the footprint proportional to the
+// live data.
+//
+// Block sizes start at `init_block_size` and double up to `max_block_size`,
+// like AllocSetContext. Requests larger than an eighth of the maximum block
+// size get a dedicated block, so one big chunk cannot pin a whole block of
+// small ones. One emptied block is kept as a spare for the next block
+// switch.
+class GenerationContext : public MemoryContextData {
+ public:
+  static constexpr Size kMinBlockSize = 1024;
+  static constexpr Size kDefaultInitBlockSize = 8 * 1024;
+  static constexpr Size kDefaultMaxBlockSize = 8 * 1024 * 1024;
+
+  GenerationContext(MemoryContext parent, std::string name,
+                    Size init_block_size, Size max_block_size);
+
+  void* alloc(Size size) override;
+  void free(void* ptr) override;
+  void* realloc(void* ptr, Size size) override;
+  void reset() override;
+  void destroy() override;
+
+  // Walk through blocks and check the chunk counts against the chunks that
+  // are actually in them.
+  //
+  // NOTE: report errors as NOTICE, *not* ERROR or FATAL. See
+  // AllocSetContext::check().
+  void check() override;
+  void count(MemoryContextCounters* counters) override;
+
+ private:
+  static constexpr Size kBlockHdrSz = MAX_ALIGN(sizeof(GenerationBlockData));
+  static constexpr Size kChunkHdrSz = MAX_ALIGN(sizeof(GenerationChunkHeader));
+
+  static GenerationChunk chunk_header(void* ptr) {
+    return reinterpret_cast<GenerationChunk>(static_cast<Pointer>(ptr) -
+                                             kChunkHdrSz);
+  }
+
+  static GenerationBlock chunk_block(GenerationChunk chunk) {
+    return untag_block<GenerationBlock>(chunk->block);
+  }
+
+  // alloc() without running the spill callbacks, for realloc(), which must
+  // copy the old chunk first.
+  void* alloc_chunk(Size size);
+
+  GenerationBlock new_block(Size blk_size);
+  GenerationBlock next_block(Size required_size);
+  void release_block(GenerationBlock block);
+  void* carve_chunk(GenerationBlock block, Size chunk_size);
+
+  void push_block(GenerationBlock block);
+  void unlink_block(GenerationBlock block);
+
+  Size init_block_size_;
+  Size max_block_size_;
+  Size next_block_size_;  // Size of the next regular block
+  Size chunk_limit_;      // Larger requests get a dedicated block
+  GenerationBlock blocks_;      // All blocks in use, newest first
+  GenerationBlock block_;       // Current block to allocate from
+  GenerationBlock free_block_;  // Emptied block kept for reuse
+};
+
+}  // namespace rdbms
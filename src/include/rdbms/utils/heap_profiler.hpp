@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+
+#include "rdbms/postgres.hpp"
+
+namespace rdbms {
+
+using MemoryContext = class MemoryContextData*;
+
+// HeapProfiler samples chunk allocations of all memory contexts and tells
+// which context and which call site hold on to the memory.
+//
+// Once started, each thread counts down the bytes it allocates and records
+// the allocation that crosses zero, together with its owning context and a
+// short call stack. The countdown restarts at an exponentially distributed
+// number of bytes averaging `sample_interval`, so an allocation of `size`
+// bytes is sampled with probability 1 - exp(-size / sample_interval)
+// whatever came before it. Each sample is weighted by the inverse of that
+// probability, which makes the sum of the weights an unbiased estimate of
+// the live bytes.
+//
+// Samples die with their chunk: when it is freed, or when its context is
+// reset or destroyed. report() walks a context tree and lists the estimated
+// live bytes of every context, broken down by call site.
+//
+// With the profiler stopped, allocating a chunk costs a single branch on
+// enabled(). Freeing one costs a branch on whether its context holds samples
+// at all, so contexts that were never sampled, or not since the last stop(),
+// do not pay for the lookup.
+class HeapProfiler {
+ public:
+  static constexpr Size kDefaultSampleInterval = 512 * 1024;
+  static constexpr int kMaxFrames = 8;
+
+  // Start sampling, or change the interval of a running profiler. Samples
+  // already taken keep their weight.
+  static void start(Size sample_interval = kDefaultSampleInterval);
+
+  // Stop sampling and drop all samples.
+  static void stop();
+
+  static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+  // Bumped by stop(), so contexts can tell that the samples they counted
+  // are gone.
+  static u64 generation() {
+    return generation_.load(std::memory_order_relaxed);
+  }
+  static Size sample_interval();
+
+  // Estimated live bytes of `context` alone, and the number of samples
+  // behind the estimate.
+  static Size live_bytes(MemoryContext context);
+  static Size live_samples(MemoryContext context);
+
+  // Render the tree rooted at `root`, one line per context followed by its
+  // call sites, heaviest first. dump() prints the report to stderr.
+  static std::string report(MemoryContext root);
+  static void dump(MemoryContext root);
+
+  // Hooks for MemoryContextData. sample_alloc() returns whether the chunk
+  // was sampled, sample_free() whether it had been.
+  static bool sample_alloc(MemoryContext context, const void* ptr, Size size);
+  static bool sample_free(const void* ptr);
+  static void forget_context(MemoryContext context);
+
+ private:
+  static inline std::atomic<bool> enabled_{false};
+  static inline std::atomic<u64> generation_{0};
+};
+
+}  // namespace rdbms
@@ -1,28 +1,169 @@
 #pragma once
 
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <functional>
 #include <string>
+#include <vector>
 
 #include "rdbms/nodes/nodes.hpp"
+#include "rdbms/utils/alloc.hpp"
+#include "rdbms/utils/heap_profiler.hpp"
 
 namespace rdbms {
 
 using MemoryContext = class MemoryContextData*;
 
+// Space held by a context, or summed up over a tree of contexts.
+struct MemoryContextCounters {
+  Size nblocks = 0;         // Blocks held
+  Size free_chunks = 0;     // Freed chunks still in those blocks
+  Size total_space = 0;     // Bytes in those blocks
+  Size free_space = 0;      // Bytes not handed out as live chunks
+  Size peak_allocated = 0;  // See MemoryContextData::peak_allocated()
+
+  Size used_space() const { return total_space - free_space; }
+
+  // Sum up the space. The peak of a subtree is the peak of its root, which
+  // is also the largest peak within it.
+  MemoryContextCounters& operator+=(const MemoryContextCounters& other) {
+    nblocks += other.nblocks;
+    free_chunks += other.free_chunks;
+    total_space += other.total_space;
+    free_space += other.free_space;
+    peak_allocated = std::max(peak_allocated, other.peak_allocated);
+
+    return *this;
+  }
+};
+
+// Every context obtains its blocks through allocate_block() and friends, which
+// keep count of the bytes and blocks it holds. The byte counts are kept for
+// the context itself and, in `total_allocated`, for the whole subtree rooted
+// at it, so a limit set on a query's top context covers everything the query
+// allocates. Only block allocations update the counters; chunk allocations
+// within a block cost nothing extra.
+//
+// Every chunk handed out by a context is immediately preceded by a word that
+// leads back to the context, so pfree() and repalloc() can find the owner of
+// any chunk in O(1) without knowing the context type. The word is one of:
+//
+//   - a pointer to the context itself;
+//   - a pointer to a block whose first member is the context, with bit 0 set
+//     (kBlockTag);
+//   - an encoded word with bits 0 and 1 set (kEncodedTag) that holds the
+//     distance from the word back to such a block in bits kOffsetShift and
+//     up. The bits in between are left to the context.
 class MemoryContextData {
  public:
+  static constexpr std::uintptr_t kBlockTag = 1;
+  static constexpr std::uintptr_t kEncodedTag = 3;
+  static constexpr int kOffsetShift = 7;
+
+  // Context that owns the chunk at `ptr`.
+  static MemoryContext chunk_context(const void* ptr) {
+    auto word_ptr = reinterpret_cast<const std::uintptr_t*>(ptr) - 1;
+    std::uintptr_t word = *word_ptr;
+
+    if ((word & kEncodedTag) == kEncodedTag) {
+      auto block = reinterpret_cast<const char*>(word_ptr) -
+                   (word >> kOffsetShift);
+
+      return *reinterpret_cast<const MemoryContext*>(block);
+    }
+
+    if (word & kBlockTag) {
+      return *reinterpret_cast<MemoryContext*>(word & ~kBlockTag);
+    }
+
+    return reinterpret_cast<MemoryContext>(word);
+  }
+
   MemoryContextData(NodeTag type, MemoryContext parent, std::string name);
-  virtual ~MemoryContextData();
+  virtual ~MemoryContextData() = default;
 
-  virtual void* alloc(Size size);
-  virtual void free(void* pointer);
-  virtual void* realloc(void* pointer, Size size);
-  virtual void reset();
-  virtual void destroy();
-  virtual void check();
-  virtual void stats();
+  virtual void* alloc(Size size) = 0;
+  virtual void free(void* pointer) = 0;
+  virtual void* realloc(void* pointer, Size size) = 0;
+  virtual void reset() = 0;
+  virtual void destroy() = 0;
+  virtual void check() = 0;
+
+  // Add the space held by this context alone to `counters`, all but
+  // `peak_allocated`. Must not allocate memory.
+  virtual void count(MemoryContextCounters* counters) = 0;
+
+  // Counters of this context alone, and summed up over the subtree rooted at
+  // it. Neither allocates memory, so monitoring can poll them cheaply.
+  MemoryContextCounters counters();
+  MemoryContextCounters tree_counters();
+
+  // Print the counters of this context to stderr in one line.
+  void stats();
+
+  // Render the subtree rooted at this context as a JSON object holding the
+  // name and counters of the context and an array of its children.
+  std::string stats_json();
 
   NodeTag type() const { return type_; }
-  std::string name() const { return name_; }
+  const std::string& name() const { return name_; }
+  MemoryContext parent() const { return parent_; }
+  MemoryContext first_child() const { return first_child_; }
+  MemoryContext next_sibling() const { return next_sibling_; }
+
+  // Bytes in blocks held by this context alone.
+  Size mem_allocated() const { return mem_allocated_; }
+
+  // Bytes in blocks held by this context and its descendants.
+  Size total_allocated() const { return total_allocated_; }
+
+  // High-water mark of total_allocated().
+  Size peak_allocated() const { return peak_allocated_; }
+
+  // Number of blocks held by this context alone.
+  Size nblocks() const { return nblocks_; }
+
+  // Cap total_allocated() at `limit` bytes; 0 means no limit. A block
+  // allocation that would exceed the limit of this context or any of its
+  // ancestors fails, and the context returns nullptr as if out of memory.
+  // Lowering the limit below the current total does not release anything.
+  void set_mem_limit(Size limit) { mem_limit_ = limit; }
+  Size mem_limit() const { return mem_limit_; }
+
+  // Called with the context whose soft limit was crossed.
+  using SpillCallback = std::function<void(MemoryContext context)>;
+
+  // Soft cap on total_allocated(); 0 means no soft limit. When a block
+  // allocation anywhere in the subtree crosses it, the spill callbacks
+  // registered on this context run, in the order they were registered, so
+  // hash tables and sort buffers can write data out to disk and release
+  // their memory before the hard limit is hit.
+  //
+  // The callbacks run once the alloc() or realloc() that crossed the limit
+  // has finished, so they may allocate and free in any context. They may
+  // reset or destroy any context but the one that allocated, since its
+  // chunk is about to be handed out; that context asserts it is left alone.
+  // A hash table whose own growth crosses the limit has to spill itself once
+  // the allocation returns. An allocation that also exceeds the hard limit
+  // still fails, but the callbacks run anyway, so a retry can succeed.
+  //
+  // The callbacks fire once per crossing: not again until total_allocated()
+  // has dropped back to the soft limit.
+  void set_soft_mem_limit(Size limit) { soft_mem_limit_ = limit; }
+  Size soft_mem_limit() const { return soft_mem_limit_; }
+
+  void register_spill_callback(SpillCallback callback) {
+    spill_callbacks_.push_back(std::move(callback));
+  }
+
+  // Times the spill callbacks of this context have fired.
+  Size nspills() const { return nspills_; }
+
+  // Take blocks of MemoryPool::huge_page_threshold() bytes or more from huge
+  // pages. Meant for contexts holding big hash tables or sort arrays.
+  void set_huge_pages(bool enabled) { huge_pages_ = enabled; }
+  bool huge_pages() const { return huge_pages_; }
 
   // Release all space allocated within a context and its descendants,
   // but don't delete the contexts themselves.
@@ -33,14 +174,123 @@ class MemoryContextData {
   void destroy_subtree();
 
  protected:
+  // Encode and decode the owner word of a chunk that points to its block.
+  static std::uintptr_t tag_block(void* block) {
+    return reinterpret_cast<std::uintptr_t>(block) | kBlockTag;
+  }
+
+  template <typename Block>
+  static Block untag_block(std::uintptr_t word) {
+    return reinterpret_cast<Block>(word & ~kBlockTag);
+  }
+
   void reset_subtree(MemoryContext context);
   void destroy_subtree(MemoryContext context);
 
+  // Tell HeapProfiler about chunks coming and going. Every context calls
+  // profile_alloc() on the chunks it hands out, profile_free() on the chunks
+  // it takes back, and profile_reset() when it drops all of them at once.
+  //
+  // HeapProfiler::stop() drops every sample without visiting the contexts,
+  // so a count taken before the last stop() is stale; the first free or
+  // reset that sees so clears it, and later frees are back to one branch.
+  void* profile_alloc(void* ptr, Size size) {
+    if (HeapProfiler::enabled()) [[unlikely]] {
+      u64 generation = HeapProfiler::generation();
+
+      if (HeapProfiler::sample_alloc(this, ptr, size)) {
+        if (sampled_generation_ != generation) {
+          sampled_generation_ = generation;
+          sampled_chunks_ = 0;
+        }
+
+        sampled_chunks_++;
+      }
+    }
+
+    return ptr;
+  }
+
+  void profile_free(const void* ptr) {
+    if (sampled_chunks_ != 0) [[unlikely]] {
+      if (sampled_generation_ != HeapProfiler::generation()) {
+        sampled_chunks_ = 0;
+      } else {
+        sampled_chunks_ -= HeapProfiler::sample_free(ptr);
+      }
+    }
+  }
+
+  void profile_reset() {
+    if (sampled_chunks_ != 0) [[unlikely]] {
+      if (sampled_generation_ == HeapProfiler::generation()) {
+        HeapProfiler::forget_context(this);
+      }
+
+      sampled_chunks_ = 0;
+    }
+  }
+
+  // Run the spill callbacks that block allocations found due, now that the
+  // chunk is carved out. Contexts pass the result of every public alloc()
+  // and realloc() through here, and nothing else.
+  //
+  // The callbacks must not reset or destroy this context, or the chunk
+  // would be freed before the caller gets it. Contexts call
+  // check_not_spilling() first thing in reset() and destroy().
+  void* run_pending_spills(void* ptr) {
+    if (spill_pending_) [[unlikely]] {
+      fire_spill_callbacks();
+    }
+
+    return ptr;
+  }
+
+  void check_not_spilling() const { assert(!spill_source_); }
+
+  // Obtain, resize and release blocks from MemoryPool on behalf of this
+  // context, keeping its accounting up to date. allocate_block() and
+  // reallocate_block() return a null Memory if MemoryPool fails or a memory
+  // limit would be exceeded; the latter is reported here. On failure,
+  // reallocate_block() leaves the original block alone.
+  Memory allocate_block(Size size);
+  Memory reallocate_block(void* block, Size size);
+  void deallocate_block(void* block);
+
   NodeTag type_;
   MemoryContext parent_;
   MemoryContext first_child_;
   MemoryContext next_sibling_;
   std::string name_;
+
+ private:
+  // Bytes this context may still allocate before it or one of its ancestors
+  // hits its memory limit.
+  Size headroom() const;
+
+  // Mark the contexts up the tree whose soft limit an allocation of `size`
+  // more bytes crosses, for run_pending_spills() to spill.
+  void check_soft_limits(Size size);
+  void fire_spill_callbacks();
+  void append_json(std::string* out);
+  void account(Size added, Size removed, int nblocks);
+
+  Size mem_allocated_ = 0;
+  Size total_allocated_ = 0;
+  Size peak_allocated_ = 0;
+  Size nblocks_ = 0;
+  Size mem_limit_ = 0;
+  Size soft_mem_limit_ = 0;
+  Size nspills_ = 0;
+  bool over_soft_limit_ = false;  // Callbacks fired since last below limit
+  bool spill_due_ = false;        // Callbacks to run at the end of alloc
+  bool spill_pending_ = false;    // Some context up the tree has spill_due_
+  bool spilling_ = false;         // Callbacks running right now
+  bool spill_source_ = false;     // Callbacks running for an alloc here
+  std::vector<SpillCallback> spill_callbacks_;
+  bool huge_pages_ = false;
+  Size sampled_chunks_ = 0;     // Live chunks known to HeapProfiler
+  u64 sampled_generation_ = 0;  // HeapProfiler::generation() of the count
 };
 
 // extern MemoryContext top_memory_context;
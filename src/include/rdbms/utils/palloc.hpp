@@ -1,3 +1,89 @@
 #pragma once
 
-namespace rdbms {}
\ No newline at end of file
+#include <cassert>
+#include <cstring>
+
+#include "rdbms/utils/aset.hpp"
+#include "rdbms/utils/mcxt.hpp"
+
+namespace rdbms {
+
+// Context that palloc() and friends allocate in. Each thread has its own.
+//
+// Code that wants to allocate in another context switches to it and back:
+//
+//   MemoryContext old_context = memory_context_switch_to(context);
+//   ...
+//   memory_context_switch_to(old_context);
+//
+// or simply lets a MemoryContextSwitcher do so for the rest of the scope.
+extern thread_local MemoryContext current_memory_context;
+
+inline MemoryContext memory_context_switch_to(MemoryContext context) {
+  MemoryContext old_context = current_memory_context;
+  current_memory_context = context;
+
+  return old_context;
+}
+
+class MemoryContextSwitcher {
+ public:
+  explicit MemoryContextSwitcher(MemoryContext context)
+      : old_context_(memory_context_switch_to(context)) {}
+
+  ~MemoryContextSwitcher() { memory_context_switch_to(old_context_); }
+
+  MemoryContextSwitcher(const MemoryContextSwitcher&) = delete;
+  MemoryContextSwitcher& operator=(const MemoryContextSwitcher&) = delete;
+
+ private:
+  MemoryContext old_context_;
+};
+
+// Allocate `size` bytes in the current memory context. Return nullptr if the
+// context cannot get the memory.
+//
+// Most allocations are small and go to an AllocSetContext, so those are
+// served inline, without the virtual call into the context.
+inline void* palloc(Size size) {
+  MemoryContext context = current_memory_context;
+  assert(context != nullptr);
+
+  if (context->type() == kAllocSetContext &&
+      size <= AllocSetContext::kChunkLimit) {
+    if (void* ptr = static_cast<AllocSet>(context)->alloc_small(size);
+        ptr != nullptr) {
+      return ptr;
+    }
+  }
+
+  return context->alloc(size);
+}
+
+// Same as palloc(), but zero the memory.
+inline void* palloc0(Size size) {
+  void* ptr = palloc(size);
+
+  if (ptr != nullptr) {
+    std::memset(ptr, 0, size);
+  }
+
+  return ptr;
+}
+
+// Free a chunk allocated by palloc() in whatever context owns it.
+inline void pfree(void* ptr) {
+  assert(ptr != nullptr);
+
+  MemoryContextData::chunk_context(ptr)->free(ptr);
+}
+
+// Resize a chunk allocated by palloc(). The chunk stays in the context that
+// owns it, regardless of the current memory context.
+inline void* repalloc(void* ptr, Size size) {
+  assert(ptr != nullptr);
+
+  return MemoryContextData::chunk_context(ptr)->realloc(ptr, size);
+}
+
+}  // namespace rdbms
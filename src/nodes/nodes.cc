@@ -1,15 +1,21 @@
 #include <cassert>
 
-#include "rdbms/nodes/nodes.h"
+#include "rdbms/nodes/nodes.hpp"
 
-#include "rdbms/postgres.h"
+#include "rdbms/utils/palloc.hpp"
 
 namespace rdbms {
 
 Node* new_node(Size size, NodeTag tag) {
   assert(size >= sizeof(Node));
 
-  Node* new_node = (Node*)palloc(size);
+  auto node = static_cast<Node*>(palloc0(size));
+
+  if (node != nullptr) {
+    node->type = tag;
+  }
+
+  return node;
 }
 
-}  // namespace rdbms
\ No newline at end of file
+}  // namespace rdbms
@@ -0,0 +1,251 @@
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstring>
+
+#include "rdbms/storage/dsa.hpp"
+
+#include "rdbms/utils/elog.hpp"
+
+namespace rdbms {
+
+// Shared state of an area, at the start of its first segment.
+struct DsaArea::Control {
+  LwLock lock;
+  int nsegments;
+  Size total_size;
+  Size next_segment_size;
+  DsaPointer free_lists[kNumSizeClasses];  // Free small chunks by size class
+  DsaPointer large_chunks;                 // Free big chunks, unsorted
+  DsmHandle handles[kMaxSegments];         // Segments by index
+  Size used[kMaxSegments];                 // Bytes carved from each segment
+};
+
+namespace {
+
+// Each chunk starts with its size, header included. A free chunk links to
+// the next one on its list.
+struct DsaChunkHeader {
+  Size size;
+  DsaPointer next;
+};
+
+constexpr Size kChunkHdrSz = MAX_ALIGN(sizeof(DsaChunkHeader));
+constexpr int kMinClassShift = 4;
+
+int size_class(Size chunk_size) {
+  return std::max(static_cast<int>(std::bit_width(chunk_size - 1)),
+                  kMinClassShift) -
+         kMinClassShift;
+}
+
+}  // namespace
+
+DsaArea::DsaArea(Size init_segment_size) : control_(nullptr), owner_(true) {
+  Size control_size = CACHE_LINE_ALIGN(sizeof(Control));
+  init_segment_size = std::max(init_segment_size, 2 * control_size);
+
+  auto seg = std::make_unique<DsmSegment>(init_segment_size, false);
+
+  if (!seg->is_ok()) {
+    return;
+  }
+
+  auto control = static_cast<Control*>(seg->address());
+  std::memset(control, 0, sizeof(Control));
+  S_LOCK_INIT(&control->lock);
+  control->nsegments = 1;
+  control->total_size = seg->size();
+  control->next_segment_size = std::min(2 * seg->size(), kMaxSegmentSize);
+  control->handles[0] = seg->handle();
+  control->used[0] = control_size;
+
+  segments_[0] = std::move(seg);
+  control_ = control;
+}
+
+DsaArea::DsaArea(DsmHandle handle) : control_(nullptr), owner_(false) {
+  auto seg = std::make_unique<DsmSegment>(handle);
+
+  if (!seg->is_ok()) {
+    return;
+  }
+
+  control_ = static_cast<Control*>(seg->address());
+  segments_[0] = std::move(seg);
+}
+
+DsaArea::~DsaArea() {
+  if (control_ == nullptr || !owner_) {
+    return;
+  }
+
+  // Unmap our own mappings first, the control data goes last.
+  for (int i = control_->nsegments - 1; i >= 0; i--) {
+    DsmHandle handle = control_->handles[i];
+    segments_[i].reset();
+    DsmSegment::remove(handle);
+  }
+}
+
+DsmHandle DsaArea::handle() const { return segments_[0]->handle(); }
+
+DsaPointer DsaArea::alloc(Size size) {
+  Size chunk_size = kChunkHdrSz + MAX_ALIGN(size);
+  DsaPointer chunk = kInvalidDsaPointer;
+
+  S_LOCK(&control_->lock);
+
+  if (chunk_size <= kMaxSmallChunk) {
+    int cls = size_class(chunk_size);
+    chunk_size = Size{1} << (cls + kMinClassShift);
+
+    if (DsaPointer head = control_->free_lists[cls];
+        head != kInvalidDsaPointer) {
+      auto header = static_cast<DsaChunkHeader*>(get_address(head));
+      control_->free_lists[cls] = header->next;
+      chunk = head;
+    }
+  } else {
+    // First fit. Big chunks are rare enough to walk the list.
+    DsaPointer* link = &control_->large_chunks;
+
+    while (*link != kInvalidDsaPointer) {
+      auto header = static_cast<DsaChunkHeader*>(get_address(*link));
+
+      if (header->size >= chunk_size) {
+        chunk = *link;
+        *link = header->next;
+        break;
+      }
+
+      link = &header->next;
+    }
+  }
+
+  if (chunk == kInvalidDsaPointer) {
+    chunk = carve(chunk_size);
+  }
+
+  S_UNLOCK(&control_->lock);
+
+  return chunk != kInvalidDsaPointer ? chunk + kChunkHdrSz
+                                     : kInvalidDsaPointer;
+}
+
+void DsaArea::free(DsaPointer dp) {
+  if (dp == kInvalidDsaPointer) {
+    return;
+  }
+
+  DsaPointer chunk = dp - kChunkHdrSz;
+  auto header = static_cast<DsaChunkHeader*>(get_address(chunk));
+
+  S_LOCK(&control_->lock);
+
+  DsaPointer* head = header->size <= kMaxSmallChunk
+                         ? &control_->free_lists[size_class(header->size)]
+                         : &control_->large_chunks;
+  header->next = *head;
+  *head = chunk;
+
+  S_UNLOCK(&control_->lock);
+}
+
+void* DsaArea::get_address(DsaPointer dp) {
+  if (dp == kInvalidDsaPointer) {
+    return nullptr;
+  }
+
+  DsmSegment* seg = segment(segment_index(dp));
+
+  if (seg == nullptr) {
+    return nullptr;
+  }
+
+  return static_cast<Pointer>(seg->address()) + segment_offset(dp);
+}
+
+Size DsaArea::total_size() {
+  S_LOCK(&control_->lock);
+  Size total_size = control_->total_size;
+  S_UNLOCK(&control_->lock);
+
+  return total_size;
+}
+
+int DsaArea::nsegments() {
+  S_LOCK(&control_->lock);
+  int nsegments = control_->nsegments;
+  S_UNLOCK(&control_->lock);
+
+  return nsegments;
+}
+
+DsaPointer DsaArea::carve(Size chunk_size) {
+  int index = control_->nsegments - 1;
+
+  if (control_->used[index] + chunk_size > segment(index)->size()) {
+    if (!add_segment(chunk_size)) {
+      return kInvalidDsaPointer;
+    }
+
+    index++;
+  }
+
+  DsaPointer chunk = make_pointer(index, control_->used[index]);
+  control_->used[index] += chunk_size;
+
+  auto header = static_cast<DsaChunkHeader*>(get_address(chunk));
+  header->size = chunk_size;
+  header->next = kInvalidDsaPointer;
+
+  return chunk;
+}
+
+bool DsaArea::add_segment(Size min_size) {
+  int index = control_->nsegments;
+
+  if (index == kMaxSegments) {
+    elog(ERROR, "%s: too many dynamic shared memory segments", __func__);
+
+    return false;
+  }
+
+  Size size = std::max(control_->next_segment_size, min_size);
+  auto seg = std::make_unique<DsmSegment>(size, false);
+
+  if (!seg->is_ok()) {
+    elog(ERROR, "%s: could not create segment of %lu bytes", __func__, size);
+
+    return false;
+  }
+
+  control_->handles[index] = seg->handle();
+  control_->used[index] = 0;
+  control_->total_size += seg->size();
+  control_->next_segment_size =
+      std::min(2 * control_->next_segment_size, kMaxSegmentSize);
+  control_->nsegments++;
+  segments_[index] = std::move(seg);
+
+  return true;
+}
+
+DsmSegment* DsaArea::segment(int index) {
+  assert(index < kMaxSegments);
+
+  if (segments_[index] == nullptr) {
+    auto seg = std::make_unique<DsmSegment>(control_->handles[index]);
+
+    if (!seg->is_ok()) {
+      return nullptr;
+    }
+
+    segments_[index] = std::move(seg);
+  }
+
+  return segments_[index].get();
+}
+
+}  // namespace rdbms
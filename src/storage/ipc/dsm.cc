@@ -0,0 +1,140 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+#include "rdbms/storage/dsm.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace rdbms {
+
+DsmSegment::DsmSegment(Size size, bool remove_on_detach)
+    : handle_(kInvalidDsmHandle),
+      address_(nullptr),
+      size_(0),
+      remove_on_detach_(remove_on_detach) {
+  static thread_local std::mt19937 gen(std::random_device{}());
+  char name[64];
+  int fd = -1;
+
+  // Pick random handles until one is free. Collisions with segments of
+  // other clusters are harmless, we simply move on.
+  for (int attempt = 0; attempt < 100 && fd < 0; attempt++) {
+    handle_ = static_cast<DsmHandle>(gen());
+
+    if (handle_ == kInvalidDsmHandle) {
+      continue;
+    }
+
+    segment_name(handle_, name, sizeof name);
+    fd = ::shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+
+    if (fd < 0 && errno != EEXIST) {
+      fprintf(stderr, "%s: shm_open(%s) failed: %s\n", __func__, name,
+              strerror(errno));
+      break;
+    }
+  }
+
+  if (fd < 0) {
+    handle_ = kInvalidDsmHandle;
+
+    return;
+  }
+
+  if (::ftruncate(fd, size) < 0) {
+    fprintf(stderr, "%s: ftruncate(%s, %lu) failed: %s\n", __func__, name,
+            size, strerror(errno));
+    ::close(fd);
+    ::shm_unlink(name);
+    handle_ = kInvalidDsmHandle;
+
+    return;
+  }
+
+  map(fd, size);
+
+  if (!is_ok()) {
+    ::shm_unlink(name);
+    handle_ = kInvalidDsmHandle;
+  }
+}
+
+DsmSegment::DsmSegment(DsmHandle handle)
+    : handle_(handle),
+      address_(nullptr),
+      size_(0),
+      remove_on_detach_(false) {
+  char name[64];
+  segment_name(handle, name, sizeof name);
+
+  int fd = ::shm_open(name, O_RDWR, 0600);
+
+  if (fd < 0) {
+    fprintf(stderr, "%s: shm_open(%s) failed: %s\n", __func__, name,
+            strerror(errno));
+
+    return;
+  }
+
+  struct stat st;
+
+  if (::fstat(fd, &st) < 0) {
+    fprintf(stderr, "%s: fstat(%s) failed: %s\n", __func__, name,
+            strerror(errno));
+    ::close(fd);
+
+    return;
+  }
+
+  map(fd, st.st_size);
+}
+
+DsmSegment::~DsmSegment() {
+  if (address_ != nullptr && ::munmap(address_, size_) < 0) {
+    fprintf(stderr, "%s: munmap(%p) failed: %s\n", __func__, address_,
+            strerror(errno));
+  }
+
+  if (remove_on_detach_ && handle_ != kInvalidDsmHandle) {
+    remove(handle_);
+  }
+}
+
+void DsmSegment::remove(DsmHandle handle) {
+  char name[64];
+  segment_name(handle, name, sizeof name);
+
+  if (::shm_unlink(name) < 0 && errno != ENOENT) {
+    fprintf(stderr, "%s: shm_unlink(%s) failed: %s\n", __func__, name,
+            strerror(errno));
+  }
+}
+
+void DsmSegment::segment_name(DsmHandle handle, char* name, Size size) {
+  snprintf(name, size, "/rdbms.dsm.%u", static_cast<u32>(handle));
+}
+
+void DsmSegment::map(int fd, Size size) {
+  void* address =
+      ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+  // The mapping keeps the object alive, the descriptor is not needed.
+  ::close(fd);
+
+  if (address == MAP_FAILED) {
+    fprintf(stderr, "%s: mmap(%lu) failed: %s\n", __func__, size,
+            strerror(errno));
+
+    return;
+  }
+
+  address_ = address;
+  size_ = size;
+}
+
+}  // namespace rdbms
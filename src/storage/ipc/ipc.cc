@@ -1,18 +1,55 @@
+#include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <csignal>
+#include <cstring>
 #include <iostream>
+#include <thread>
 #include <vector>
 
 #include "rdbms/storage/ipc.hpp"
 
+#include <sys/mman.h>
 #include <sys/shm.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "rdbms/storage/lock_stats.hpp"
 #include "rdbms/utils/alloc.hpp"
 
 using namespace rdbms;
 
+// Linux leaves it to the caller to define the semctl() argument.
+#if defined(__linux__)
+union semun {
+  int val;
+  struct semid_ds* buf;
+  unsigned short* array;
+};
+#endif
+
+key_t rdbms::ipc_key_from_path(const char* path) {
+  struct stat st;
+
+  if (::stat(path, &st) < 0) {
+    fprintf(stderr, "%s: stat(%s) failed: %s\n", __func__, path,
+            strerror(errno));
+
+    return -1;
+  }
+
+  // Mix the device into the inode; ftok() keeps only a few bits of each,
+  // which collides for data directories on the same file system. Keep the
+  // key positive and leave room above it to probe.
+  u64 h = (static_cast<u64>(st.st_dev) << 32) ^ st.st_ino;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+
+  return static_cast<key_t>(h % 0x7fff0000 + 1);
+}
+
 int Semaphore::next_key_ = 0;
 
 Semaphore::Semaphore(int nsems, int permission, int start_value,
@@ -23,6 +60,18 @@ Semaphore::Semaphore(int nsems, int permission, int start_value,
   set_marker_at_end(nsems);
 }
 
+bool Semaphore::set_key_base(key_t key) {
+  if (key <= 0) {
+    fprintf(stderr, "%s: invalid IPC key %d\n", __func__, key);
+
+    return false;
+  }
+
+  next_key_ = key - 1;
+
+  return true;
+}
+
 Semaphore::~Semaphore() {
   if (remove_on_exit_) {
     kill();
@@ -82,12 +131,45 @@ void Semaphore::acquire(int semnum, bool interrupt_ok) {
   // necessary state updates. It's not true for SysV semaphores used to
   // emulate spinlocks --- but our performance on such platforms is so
   // horrible anyway that I'm not going to worry too much about it.)
-  do {
+  //
+  // When lock waits are counted, the first semop() does not block, so that
+  // we know whether we are about to wait, and on what.
+  bool track = LockStats::enabled();
+  std::chrono::steady_clock::time_point start;
+
+  if (track) {
+    sops.sem_flg = IPC_NOWAIT;
+  }
+
+  while (true) {
     STORE(g_immediate_interrupt_ok, interrupt_ok);
     CHECK_FOR_INTERRUPTS();
     err_status = semop(semid_, &sops, 1);
     STORE(g_immediate_interrupt_ok, false);
-  } while (err_status == -1 && errno == EINTR);
+
+    if (err_status == -1 && errno == EAGAIN && sops.sem_flg == IPC_NOWAIT) {
+      sops.sem_flg = 0;
+      start = std::chrono::steady_clock::now();
+      LockStats::report_wait_start(WaitEventType::kSemaphore,
+                                   kSemaphoreLocks, this);
+      continue;
+    }
+
+    if (err_status == 0 || errno != EINTR) {
+      break;
+    }
+  }
+
+  if (track) {
+    LockStats::count_acquire(kSemaphoreLocks, this);
+
+    if (sops.sem_flg == 0) {
+      auto wait_usec = std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - start);
+      LockStats::report_wait_end();
+      LockStats::count_wait(kSemaphoreLocks, this, 0, 1, wait_usec.count());
+    }
+  }
 
   if (err_status == -1) {
     fprintf(stderr, "%s: semop(id=%d) failed: %s\n", __func__, semid_,
@@ -341,8 +423,9 @@ int Semaphore::try_create_semid(key_t key, int nsems, int permission) {
 }
 
 void Semaphore::init(int nsems, int start_value) {
+  // SETALL covers the marker too; set_marker_at_end() sets it afterwards.
   union semun semun;
-  std::vector<u_short> init_values(nsems, start_value);
+  std::vector<u_short> init_values(nsems + 1, start_value);
 
   semun.array = init_values.data();
 
@@ -393,32 +476,72 @@ void Semaphore::set_marker_at_end(int semnum) {
 // Shared Memory
 // ======================================================================
 int SharedMemory::next_key_ = 0;
+HugePages SharedMemory::huge_pages_ = HugePages::kTry;
+int SharedMemory::prefault_workers_ = 0;
+
+bool SharedMemory::set_key_base(key_t key) {
+  if (key <= 0) {
+    fprintf(stderr, "%s: invalid IPC key %d\n", __func__, key);
+
+    return false;
+  }
+
+  next_key_ = key - 1;
+
+  return true;
+}
 
 SharedMemory::SharedMemory(Size size, int permission, bool is_private)
-    : is_private_(is_private), shmid_(kBadShmid) {
+    : is_private_(is_private),
+      shmid_(kBadShmid),
+      uses_huge_pages_(false),
+      mapped_size_(size),
+      shmaddr_(nullptr),
+      interlock_(nullptr) {
   void* ptr;
 
   if (is_private) {
     ptr = create_private_memory(size);
   } else {
-    auto res = create_shared_memory(size, permission);
+    // Take the interlock first, so we never map a segment we must give up.
+    auto res = create_shared_memory(sizeof(PGShmemHeader), permission);
     shmid_ = res.first;
-    ptr = res.second;
+    interlock_ =
+        ::new (res.second) PGShmemHeader(kPGShmemMagic, getpid(), size, 0);
+    ptr = map_anonymous(size);
   }
 
-  shmaddr_ = ::new (ptr) PGShmemHeader(kPGShmemMagic, getpid(), size,
-                                       MAX_ALIGN(sizeof(PGShmemHeader)));
+  // Private memory is only max-aligned, so align the free space itself
+  // rather than its offset.
+  auto base = reinterpret_cast<std::uintptr_t>(ptr);
+  Size free_offset = CACHE_LINE_ALIGN(base + sizeof(PGShmemHeader)) - base;
+
+  shmaddr_ = ::new (ptr)
+      PGShmemHeader(kPGShmemMagic, getpid(), size, free_offset);
 }
 
 SharedMemory::~SharedMemory() {
   if (is_private_) {
     remove_private_memory(shmaddr_);
   } else {
-    detach_shared_memory(shmaddr_);
+    if (::munmap(shmaddr_, mapped_size_) < 0) {
+      fprintf(stderr, "%s: munmap(%p, %lu) failed: %s\n", __func__,
+              static_cast<void*>(shmaddr_), mapped_size_, strerror(errno));
+    }
+
+    detach_shared_memory(interlock_);
     remove_shared_memory(shmid_);
   }
 }
 
+void SharedMemory::set_huge_pages(HugePages huge_pages) {
+  huge_pages_ = huge_pages;
+}
+
+void SharedMemory::set_prefault_workers(int nworkers) {
+  prefault_workers_ = std::max(nworkers, 0);
+}
+
 void* SharedMemory::create_private_memory(Size size) {
   auto mem = MemoryPool::allocate(size);
   auto ptr = mem.ptr;
@@ -525,6 +648,84 @@ std::pair<int, void*> SharedMemory::try_create_shared_memory(key_t key,
   return {shmid, shmaddr};
 }
 
+void* SharedMemory::map_anonymous(Size size) {
+  Size page_size = ::sysconf(_SC_PAGESIZE);
+  void* ptr = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+  if (huge_pages_ != HugePages::kOff) {
+    Size huge_page_size = MemoryPool::huge_page_size();
+
+    // MAP_HUGETLB only maps whole huge pages.
+    mapped_size_ = TYPE_ALIGN(huge_page_size, size);
+    ptr = ::mmap(nullptr, mapped_size_, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+    if (ptr != MAP_FAILED) {
+      uses_huge_pages_ = true;
+      page_size = huge_page_size;
+    } else if (huge_pages_ == HugePages::kOn) {
+      fprintf(stderr,
+              "%s: mmap(%lu) with MAP_HUGETLB failed: %s\n"
+              "This error usually means that the kernel has fewer huge pages\n"
+              "reserved than the segment needs. Raise vm.nr_hugepages, or\n"
+              "set huge_pages to try.\n",
+              __func__, mapped_size_, strerror(errno));
+      ExitManager::proc_exit(1);
+    }
+  }
+#else
+  if (huge_pages_ == HugePages::kOn) {
+    fprintf(stderr, "%s: huge pages not supported on this platform\n",
+            __func__);
+    ExitManager::proc_exit(1);
+  }
+#endif
+
+  if (ptr == MAP_FAILED) {
+    mapped_size_ = TYPE_ALIGN(page_size, size);
+    ptr = ::mmap(nullptr, mapped_size_, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if (ptr == MAP_FAILED) {
+      fprintf(stderr, "%s: mmap(%lu) failed: %s\n", __func__, mapped_size_,
+              strerror(errno));
+      ExitManager::proc_exit(1);
+    }
+  }
+
+  if (prefault_workers_ > 0) {
+    prefault(ptr, mapped_size_, page_size, prefault_workers_);
+  }
+
+  return ptr;
+}
+
+// Touch every page of the fresh segment, so backends do not take the page
+// faults on first use. The segment is still all zeros, so writing a zero
+// byte changes nothing but the page tables.
+void SharedMemory::prefault(void* ptr, Size size, Size page_size,
+                            int nworkers) {
+  auto base = static_cast<volatile char*>(ptr);
+  Size npages = size / page_size;
+  Size pages_per_worker = (npages + nworkers - 1) / nworkers;
+  std::vector<std::thread> workers;
+
+  for (Size first = 0; first < npages; first += pages_per_worker) {
+    Size last = std::min(first + pages_per_worker, npages);
+
+    workers.emplace_back([=] {
+      for (Size i = first; i < last; i++) {
+        base[i * page_size] = 0;
+      }
+    });
+  }
+
+  for (auto& worker : workers) {
+    worker.join();
+  }
+}
+
 void SharedMemory::remove_shared_memory(int shmid) {
   if (::shmctl(shmid, IPC_RMID, nullptr) < 0) {
     fprintf(stderr, "%s: shmctl(%d, %d, 0) failed: %s\n", __func__, shmid,
@@ -571,6 +772,16 @@ bool SharedMemory::discover_and_remove_legacy_shmem(key_t key) {
     }
   }
 
+  // Backends of a dead postmaster keep the interlock attached for as long as
+  // they use the main segment. Our own attachment is the only one allowed.
+  struct shmid_ds shm_ds;
+
+  if (::shmctl(shmid, IPC_STAT, &shm_ds) < 0 || shm_ds.shm_nattch > 1) {
+    detach_shared_memory(shmaddr);
+
+    return false;
+  }
+
   // The segment appears to be from a dead Postgres process, or from
   // a previous cycle of life in this same process.  Zap it, if
   // possible. This probably shouldn't fail, but if it does, assume
@@ -0,0 +1,217 @@
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+
+#include "rdbms/storage/lock_stats.hpp"
+
+#include <unistd.h>
+
+namespace rdbms {
+
+namespace {
+
+// A wait event packs into one word, so that readers never see half of one:
+// the type in the top 8 bits, the id plus 1 in the next 8, and the low 48
+// bits of the lock address, which is all of a user space address.
+constexpr int kTypeShift = 56;
+constexpr int kIdShift = 48;
+constexpr u64 kAddressMask = (u64{1} << kIdShift) - 1;
+
+u64 now_usec() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Counters have a single writer, the backend owning the slot, so a relaxed
+// load and store make a race-free update without a locked instruction.
+void bump(u64& field, u64 delta) {
+  std::atomic_ref<u64> ref(field);
+  ref.store(ref.load(std::memory_order_relaxed) + delta,
+            std::memory_order_relaxed);
+}
+
+u64 read(const u64& field) {
+  return std::atomic_ref<u64>(const_cast<u64&>(field))
+      .load(std::memory_order_relaxed);
+}
+
+LockCounters read(const LockCounters& counters) {
+  return {read(counters.nacquires), read(counters.ncontended),
+          read(counters.nspins), read(counters.nsleeps),
+          read(counters.wait_usec)};
+}
+
+int stat_index(int lock_id) { return lock_id < 0 ? kOtherSpinLocks : lock_id; }
+
+}  // namespace
+
+struct LockStats::BackendSlot {
+  struct Instance {
+    const void* lock;  // nullptr while unused
+    LockCounters counters;
+  };
+
+  std::atomic<pid_t> pid;
+  std::atomic<u64> wait_event;
+  std::atomic<u64> wait_start_usec;
+  LockCounters by_id[kNumLockStatIds];
+  Instance instances[kMaxInstances];
+
+  // Find the entry of `lock`, adding it if there is room.
+  LockCounters* instance(const void* lock) {
+    Size hash = std::hash<const void*>{}(lock);
+
+    for (int i = 0; i < kMaxInstances; i++) {
+      Instance* entry = &instances[(hash + i) % kMaxInstances];
+      std::atomic_ref<const void*> key(entry->lock);
+
+      if (key.load(std::memory_order_relaxed) == lock) {
+        return &entry->counters;
+      }
+
+      if (key.load(std::memory_order_relaxed) == nullptr) {
+        key.store(lock, std::memory_order_release);
+
+        return &entry->counters;
+      }
+    }
+
+    return nullptr;
+  }
+};
+
+thread_local LockStats::BackendSlot* LockStats::my_slot_ = nullptr;
+
+LockStats::LockStats(ShmemAllocator* shmem, int max_backends)
+    : slots_(nullptr), max_backends_(max_backends) {
+  bool found;
+  auto slots = static_cast<BackendSlot*>(shmem->init_struct(
+      "LockStats", sizeof(BackendSlot) * max_backends, &found));
+
+  if (slots == nullptr) {
+    return;
+  }
+
+  if (!found) {
+    std::memset(static_cast<void*>(slots), 0,
+                sizeof(BackendSlot) * max_backends);
+  }
+
+  slots_ = slots;
+}
+
+void LockStats::attach(int backend_id) {
+  BackendSlot* slot = &slots_[backend_id];
+
+  slot->pid.store(getpid(), std::memory_order_relaxed);
+  my_slot_ = slot;
+}
+
+void LockStats::detach() {
+  if (my_slot_ != nullptr) {
+    my_slot_->wait_event.store(0, std::memory_order_relaxed);
+    my_slot_->pid.store(0, std::memory_order_relaxed);
+    my_slot_ = nullptr;
+  }
+}
+
+void LockStats::report_wait_start(WaitEventType type, int lock_id,
+                                  const void* lock) {
+  if (my_slot_ == nullptr) {
+    return;
+  }
+
+  u64 event = (static_cast<u64>(type) << kTypeShift) |
+              (static_cast<u64>(stat_index(lock_id) + 1) << kIdShift) |
+              (reinterpret_cast<std::uintptr_t>(lock) & kAddressMask);
+
+  my_slot_->wait_start_usec.store(now_usec(), std::memory_order_relaxed);
+  my_slot_->wait_event.store(event, std::memory_order_release);
+}
+
+void LockStats::report_wait_end() {
+  if (my_slot_ != nullptr) {
+    my_slot_->wait_event.store(0, std::memory_order_relaxed);
+  }
+}
+
+void LockStats::count_acquire(int lock_id, const void* lock) {
+  if (my_slot_ == nullptr) {
+    return;
+  }
+
+  bump(my_slot_->by_id[stat_index(lock_id)].nacquires, 1);
+
+  if (LockCounters* counters = my_slot_->instance(lock)) {
+    bump(counters->nacquires, 1);
+  }
+}
+
+void LockStats::count_wait(int lock_id, const void* lock, u64 nspins,
+                           u64 nsleeps, u64 wait_usec) {
+  if (my_slot_ == nullptr) {
+    return;
+  }
+
+  for (LockCounters* counters :
+       {&my_slot_->by_id[stat_index(lock_id)], my_slot_->instance(lock)}) {
+    if (counters != nullptr) {
+      bump(counters->ncontended, 1);
+      bump(counters->nspins, nspins);
+      bump(counters->nsleeps, nsleeps);
+      bump(counters->wait_usec, wait_usec);
+    }
+  }
+}
+
+LockCounters LockStats::counters(int lock_id) const {
+  LockCounters sum{};
+
+  for (int i = 0; i < max_backends_; i++) {
+    sum += read(slots_[i].by_id[stat_index(lock_id)]);
+  }
+
+  return sum;
+}
+
+LockCounters LockStats::instance_counters(const void* lock) const {
+  LockCounters sum{};
+
+  for (int i = 0; i < max_backends_; i++) {
+    for (const auto& entry : slots_[i].instances) {
+      std::atomic_ref<const void*> key(
+          const_cast<const void*&>(entry.lock));
+
+      if (key.load(std::memory_order_acquire) == lock) {
+        sum += read(entry.counters);
+      }
+    }
+  }
+
+  return sum;
+}
+
+pid_t LockStats::pid(int backend_id) const {
+  return slots_[backend_id].pid.load(std::memory_order_relaxed);
+}
+
+WaitEvent LockStats::wait_event(int backend_id) const {
+  const BackendSlot* slot = &slots_[backend_id];
+  u64 event = slot->wait_event.load(std::memory_order_acquire);
+
+  if (event == 0) {
+    return {WaitEventType::kNone, -1, nullptr, 0};
+  }
+
+  u64 start = slot->wait_start_usec.load(std::memory_order_relaxed);
+  u64 now = now_usec();
+
+  return {static_cast<WaitEventType>(event >> kTypeShift),
+          static_cast<int>((event >> kIdShift) & 0xff) - 1,
+          reinterpret_cast<const void*>(event & kAddressMask),
+          now > start ? now - start : 0};
+}
+
+}  // namespace rdbms
@@ -0,0 +1,110 @@
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#include "rdbms/storage/sema.hpp"
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "rdbms/storage/ipc.hpp"
+#include "rdbms/utils/globals.hpp"
+
+namespace rdbms {
+
+namespace {
+
+// Sleep while `*addr` is still `expected`. Return -1 with errno set to EINTR
+// if a signal arrived, or to EAGAIN if the value had already changed.
+//
+// No FUTEX_PRIVATE_FLAG: the semaphore is shared between processes.
+int futex_wait(std::atomic<u32>* addr, u32 expected) {
+#if defined(__linux__)
+  return ::syscall(SYS_futex, reinterpret_cast<u32*>(addr), FUTEX_WAIT,
+                   expected, nullptr, nullptr, 0);
+#else
+  if (addr->load(std::memory_order_relaxed) != expected) {
+    errno = EAGAIN;
+
+    return -1;
+  }
+
+  std::this_thread::sleep_for(std::chrono::microseconds(100));
+
+  return 0;
+#endif
+}
+
+void futex_wake(std::atomic<u32>* addr, int nwake) {
+#if defined(__linux__)
+  ::syscall(SYS_futex, reinterpret_cast<u32*>(addr), FUTEX_WAKE, nwake,
+            nullptr, nullptr, 0);
+#else
+  IGNORE(addr);
+  IGNORE(nwake);
+#endif
+}
+
+}  // namespace
+
+void FutexSemaphore::acquire(bool interrupt_ok) {
+  // Same protocol as Semaphore::acquire(): check for a cancel/die interrupt
+  // each time around the loop, with ImmediateInterruptOK set as the caller
+  // allows, and not once we hold the semaphore. A signal makes futex_wait()
+  // return EINTR, which brings us back to the check.
+  while (true) {
+    STORE(g_immediate_interrupt_ok, interrupt_ok);
+    CHECK_FOR_INTERRUPTS();
+
+    if (try_acquire()) {
+      STORE(g_immediate_interrupt_ok, false);
+
+      return;
+    }
+
+    // Announce ourselves before sleeping. release() bumps the counter before
+    // looking for waiters, and both sides are sequentially consistent, so
+    // either it sees us or the kernel sees its new value and does not let us
+    // sleep.
+    nwaiters_.fetch_add(1);
+    int err_status = futex_wait(&value_, 0);
+    nwaiters_.fetch_sub(1, std::memory_order_relaxed);
+    STORE(g_immediate_interrupt_ok, false);
+
+    if (err_status < 0 && errno != EINTR && errno != EAGAIN) {
+      fprintf(stderr, "%s: futex(%p) failed: %s\n", __func__,
+              static_cast<void*>(&value_), strerror(errno));
+
+      ExitManager::proc_exit(1);
+    }
+  }
+}
+
+bool FutexSemaphore::try_acquire() {
+  u32 value = value_.load(std::memory_order_relaxed);
+
+  while (value > 0) {
+    if (value_.compare_exchange_weak(value, value - 1,
+                                     std::memory_order_acquire,
+                                     std::memory_order_relaxed)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void FutexSemaphore::release(std::ptrdiff_t update) {
+  value_.fetch_add(update);
+
+  if (nwaiters_.load() > 0) {
+    futex_wake(&value_, update);
+  }
+}
+
+}  // namespace rdbms
@@ -0,0 +1,131 @@
+#include <cstring>
+#include <functional>
+#include <string_view>
+
+#include "rdbms/storage/shmem.hpp"
+
+#include "rdbms/utils/elog.hpp"
+
+namespace rdbms {
+
+ShmemAllocator::ShmemAllocator(Size size, int permission, bool is_private)
+    : shared_mem_(size, permission, is_private) {
+  auto index = static_cast<ShmemIndexData*>(alloc(sizeof(ShmemIndexData)));
+
+  // Leave index_offset at 0, which is_ok() and init_struct() check.
+  if (index == nullptr) {
+    elog(FATAL, "%s: shared memory segment of %lu bytes too small for index",
+         __func__, size);
+
+    return;
+  }
+
+  std::memset(index, 0, sizeof(ShmemIndexData));
+  S_LOCK_INIT(&index->lock);
+  shared_mem_.shmaddr_->index_offset =
+      reinterpret_cast<Pointer>(index) - base();
+}
+
+void* ShmemAllocator::alloc(Size size) {
+  SharedMemory::PGShmemHeader* header = shared_mem_.shmaddr_;
+  size = CACHE_LINE_ALIGN(size);
+
+  // Only advance the offset if the request fits, so a request too big for
+  // what is left does not fail the smaller ones after it. Nothing else is
+  // published through the offset, so relaxed ordering does.
+  Size offset = header->free_offset.load(std::memory_order_relaxed);
+
+  do {
+    if (size > header->total_size - offset) {
+      elog(NOTICE, "%s: out of shared memory allocating %lu bytes", __func__,
+           size);
+
+      return nullptr;
+    }
+  } while (!header->free_offset.compare_exchange_weak(
+      offset, offset + size, std::memory_order_relaxed));
+
+  return base() + offset;
+}
+
+void* ShmemAllocator::init_struct(const char* name, Size size, bool* found) {
+  std::string_view key(name, strnlen(name, ShmemIndexEnt::kKeySize));
+
+  if (key.size() == ShmemIndexEnt::kKeySize) {
+    elog(ERROR, "%s: shared memory name \"%s\" too long", __func__, name);
+
+    return nullptr;
+  }
+
+  if (!is_ok()) {
+    elog(ERROR, "%s: shared memory has no index for \"%s\"", __func__, name);
+
+    return nullptr;
+  }
+
+  ShmemIndexData* index = this->index();
+  Size hash = std::hash<std::string_view>{}(key);
+  void* ptr = nullptr;
+
+  *found = false;
+  S_LOCK(&index->lock);
+
+  for (int i = 0; i < kShmemIndexSize; i++) {
+    ShmemIndexEnt* entry = &index->entries[(hash + i) % kShmemIndexSize];
+
+    if (entry->offset == 0) {
+      if (index->nentries == kShmemIndexSize - 1) {
+        elog(ERROR, "%s: shared memory index full adding \"%s\"", __func__,
+             name);
+        break;
+      }
+
+      ptr = alloc(size);
+
+      if (ptr == nullptr) {
+        elog(ERROR, "%s: not enough shared memory for \"%s\" of %lu bytes",
+             __func__, name, size);
+        break;
+      }
+
+      std::memcpy(entry->key, key.data(), key.size());
+      entry->key[key.size()] = '\0';
+      entry->offset = static_cast<Pointer>(ptr) - base();
+      entry->size = size;
+      index->nentries++;
+      break;
+    }
+
+    if (key == entry->key) {
+      if (entry->size != size) {
+        elog(ERROR, "%s: shared memory \"%s\" has size %lu, not %lu",
+             __func__, name, entry->size, size);
+        break;
+      }
+
+      *found = true;
+      ptr = base() + entry->offset;
+      break;
+    }
+  }
+
+  S_UNLOCK(&index->lock);
+
+  return ptr;
+}
+
+bool ShmemAllocator::is_valid(const void* ptr) const {
+  SharedMemory::PGShmemHeader* header = shared_mem_.shmaddr_;
+  auto p = static_cast<const char*>(ptr);
+  Size end = header->free_offset.load(std::memory_order_relaxed);
+
+  return p >= base() + sizeof(SharedMemory::PGShmemHeader) && p < base() + end;
+}
+
+Size ShmemAllocator::available() const {
+  SharedMemory::PGShmemHeader* header = shared_mem_.shmaddr_;
+  return header->total_size -
+         header->free_offset.load(std::memory_order_relaxed);
+}
+
+}  // namespace rdbms
@@ -1,36 +1,44 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
 
 #include "rdbms/storage/slock.hpp"
 
 #include <sys/select.h>
 
+#include "rdbms/storage/lock_stats.hpp"
 #include "rdbms/utils/globals.hpp"
 
 using namespace rdbms;
 
 namespace rdbms {
 
-// Each time we busy spin we select the next element of this array as the
-// number of microseconds to wait. This accomplishes pseudo random back-off.
+// A failed tas() first spins, re-reading the lock with a plain load and
+// telling the CPU we are spinning, for up to spins_per_delay iterations.
+// Only then do we sleep, starting at kMinDelayUsec and growing the delay by
+// a random factor between 1 and 2 each time, so that waiters that collided
+// once drift apart. Past kMaxDelayUsec the delay starts over.
 //
-// Note that on most platforms, specified values will be rounded up to the
-// next multiple of a clock tick, which is often ten milliseconds (10000).
-// So, we are being way overoptimistic to assume that these different values
-// are really different, other than the last.  But there are a few platforms
-// with better-than-usual timekeeping, and on these we will get pretty good
-// pseudo-random behavior.
-//
-// Total time to cycle through all 20 entries will be at least 100 msec,
-// more commonly (10 msec resolution) 220 msec, and on some platforms
-// as much as 420 msec (when the remainder of the current tick cycle is
-// ignored in deciding when to time out, as on FreeBSD and older Linuxen).
-// We use the 100msec figure to figure max_spins, so actual timeouts may
-// be as much as four times the nominal value, but will never be less.
-
-#define S_NSPIN_CYCLE   20
-#define AVG_SPINCYCLE   5000  // Average entry in microsec: 100ms / 20
-#define DEFAULT_TIMEOUT (100 * 1000000)  // Default timeout: 100 sec
+// spins_per_delay tunes itself. Each time we get the lock without sleeping,
+// spinning was worth it and it grows a lot; each time we had to sleep,
+// spinning was wasted and it shrinks a little. On a multiprocessor with
+// short critical sections it settles at kMaxSpinsPerDelay, and lock holders
+// never see a waiter sleep; on a uniprocessor, where spinning cannot help
+// since the holder is not running, it settles at kMinSpinsPerDelay.
+
+constexpr int kMinSpinsPerDelay = 10;
+constexpr int kMaxSpinsPerDelay = 1000;
+constexpr int kDefaultSpinsPerDelay = 100;
+constexpr int kMinDelayUsec = 1000;
+constexpr int kMaxDelayUsec = 1000000;
+constexpr long kTimeoutUsec = 100 * 1000000L;  // Give up after 100 sec
+
+static std::atomic<int> s_spins_per_delay{kDefaultSpinsPerDelay};
 
 static void slock_stuck(LwLock* lock, const char* file, int lineno) {
   fprintf(stderr, "FATAL: %s(%p) at %s:%d, stuck spinlock. Aborting.\n",
@@ -38,46 +46,44 @@ static void slock_stuck(LwLock* lock, const char* file, int lineno) {
   abort();
 }
 
-// Sleep a pseudo-random amount of time, check for timeout
-//
-// The 'timeout' is given in microsec, or may be 0 for "infinity".	Note
-// that this will be a lower bound (a fairly loose lower bound, on most
-// platforms).
-//
-// 'microsec' is the number of microsec to delay per loop.	Normally
-// 'microsec' is 0, specifying to use the next s_spincycle[] value.
-// Some callers may pass a nonzero interval, specifying to use exactly that
-// delay value rather than a pseudo-random delay.
-static void slock_sleep(unsigned int spins, int timeout, int micro_sec,
-                        LwLock* lock, const char* filename, int lineno) {
-  static int spincycle[S_NSPIN_CYCLE] = {
-      1,    10,    100,  1000, 10000, 1000, 1000,  1000, 10000, 1000,
-      1000, 10000, 1000, 1000, 10000, 1000, 10000, 1000, 10000, 30000};
+static inline void spin_delay() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("isb" ::: "memory");
+#endif
+}
 
+static void slock_sleep(int micro_sec) {
   struct timeval delay;
 
-  if (micro_sec > 0) {
-    delay.tv_sec = micro_sec / 1000000;
-    delay.tv_usec = micro_sec % 1000000;
-  } else {
-    delay.tv_sec = 0;
-    delay.tv_usec = spincycle[spins % S_NSPIN_CYCLE];
-    micro_sec = AVG_SPINCYCLE;
-  }
-
-  if (timeout > 0) {
-    unsigned int max_spins = timeout / micro_sec;
-
-    if (spins > max_spins) {
-      slock_stuck(lock, filename, lineno);
-    }
-  }
-
+  delay.tv_sec = micro_sec / 1000000;
+  delay.tv_usec = micro_sec % 1000000;
   (void)select(0, nullptr, nullptr, nullptr, &delay);
 }
 
-void slock(LwLock* lock, const char* filename, int lineno) {
-  unsigned int spins = 0;
+int spins_per_delay() {
+  return s_spins_per_delay.load(std::memory_order_relaxed);
+}
+
+unsigned int slock(LwLock* lock, const char* filename, int lineno,
+                   int lock_id) {
+  static thread_local std::minstd_rand gen(std::random_device{}());
+  std::uniform_real_distribution<double> factor(1.0, 2.0);
+
+  int max_spins = spins_per_delay();
+  int spins = 0;
+  int cur_delay = 0;
+  long slept = 0;
+  unsigned int ndelays = 0;
+  u64 total_spins = 0;
+  bool track = LockStats::enabled();
+  std::chrono::steady_clock::time_point start;
+
+  if (track) {
+    start = std::chrono::steady_clock::now();
+    LockStats::report_wait_start(WaitEventType::kSpinLock, lock_id, lock);
+  }
 
   // If you are thinking of changing this code, be careful.  This same
   // loop logic is used in other places that call TAS() directly.
@@ -87,10 +93,141 @@ void slock(LwLock* lock, const char* filename, int lineno) {
   // can be omitted in places that know they are inside a critical
   // section. Note that an interrupt must NOT be accepted after
   // acquiring the lock.
-  while (tas(lock)) {
-    slock_sleep(spins++, DEFAULT_TIMEOUT, 0, lock, filename, lineno);
+  //
+  // Only retry tas() once the lock looks free: a locked exchange on a taken
+  // lock would steal its cache line from the holder for nothing.
+  while (__atomic_load_n(lock, __ATOMIC_RELAXED) != 0 || tas(lock)) {
+    total_spins++;
+
+    if (++spins < max_spins) {
+      spin_delay();
+      continue;
+    }
+
+    if (cur_delay == 0) {
+      cur_delay = kMinDelayUsec;
+    }
+
+    if (slept > kTimeoutUsec) {
+      slock_stuck(lock, filename, lineno);
+    }
+
+    slock_sleep(cur_delay);
+    slept += cur_delay;
+    ndelays++;
     CHECK_FOR_INTERRUPTS();
+
+    cur_delay = static_cast<int>(cur_delay * factor(gen) + 0.5);
+
+    if (cur_delay > kMaxDelayUsec) {
+      cur_delay = kMinDelayUsec;
+    }
+
+    spins = 0;
+  }
+
+  // Racing updates from other threads may get lost; that only slows down
+  // the tuning.
+  if (cur_delay == 0) {
+    max_spins = std::min(max_spins + 100, kMaxSpinsPerDelay);
+  } else {
+    max_spins = std::max(max_spins - 1, kMinSpinsPerDelay);
+  }
+
+  s_spins_per_delay.store(max_spins, std::memory_order_relaxed);
+
+  if (track) {
+    auto wait_usec = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+    LockStats::report_wait_end();
+    LockStats::count_wait(lock_id, lock, total_spins, ndelays,
+                          wait_usec.count());
   }
+
+  return ndelays;
+}
+
+// Spin on `flag` until it is false, yielding the CPU now and then. With a
+// single CPU the holder cannot run while we spin, so yield right away.
+static void mcs_wait(const std::atomic<bool>& flag) {
+  static const int max_spins =
+      std::thread::hardware_concurrency() > 1 ? kMaxSpinsPerDelay : 1;
+
+  for (int spins = 1; flag.load(std::memory_order_acquire); spins++) {
+    if (spins % max_spins == 0) {
+      std::this_thread::yield();
+    } else {
+      spin_delay();
+    }
+  }
+}
+
+McsLock::Node*& McsLock::free_nodes() {
+  static thread_local Node* free_nodes = nullptr;
+
+  return free_nodes;
+}
+
+McsLock::Node* McsLock::get_node() {
+  // Owns every node the thread ever used; the free ones are also linked
+  // from free_nodes().
+  static thread_local std::vector<std::unique_ptr<Node>> nodes;
+
+  if (free_nodes() == nullptr) {
+    nodes.push_back(std::make_unique<Node>());
+    put_node(nodes.back().get());
+  }
+
+  Node* node = free_nodes();
+  free_nodes() = node->free_next;
+
+  return node;
+}
+
+void McsLock::put_node(Node* node) {
+  node->free_next = free_nodes();
+  free_nodes() = node;
+}
+
+void McsLock::acquire() {
+  Node* node = get_node();
+  node->next.store(nullptr, std::memory_order_relaxed);
+  node->locked.store(true, std::memory_order_relaxed);
+
+  Node* pred = tail_.exchange(node, std::memory_order_acq_rel);
+
+  if (pred != nullptr) {
+    pred->next.store(node, std::memory_order_release);
+    mcs_wait(node->locked);
+  }
+
+  holder_ = node;
+}
+
+void McsLock::release() {
+  Node* node = holder_;
+  Node* next = node->next.load(std::memory_order_acquire);
+
+  if (next == nullptr) {
+    // No known successor: if we are still the tail, the lock becomes free.
+    Node* expected = node;
+
+    if (tail_.compare_exchange_strong(expected, nullptr,
+                                      std::memory_order_release,
+                                      std::memory_order_relaxed)) {
+      put_node(node);
+
+      return;
+    }
+
+    // A successor swapped itself in, but has not linked itself yet.
+    while ((next = node->next.load(std::memory_order_acquire)) == nullptr) {
+      spin_delay();
+    }
+  }
+
+  next->locked.store(false, std::memory_order_release);
+  put_node(node);
 }
 
 }  // namespace rdbms
\ No newline at end of file
@@ -0,0 +1,53 @@
+#include <new>
+
+#include "rdbms/storage/spin.hpp"
+
+#include "rdbms/storage/lock_stats.hpp"
+
+namespace rdbms {
+
+SpinManager::SpinManager(ShmemAllocator* shmem) : slots_(nullptr) {
+  bool found;
+  auto slots = static_cast<SpinSlot*>(
+      shmem->init_struct("SpinLocks", sizeof(SpinSlot) * kMaxSpins, &found));
+
+  if (slots == nullptr) {
+    return;
+  }
+
+  if (!found) {
+    for (int i = 0; i < kMaxSpins; i++) {
+      SpinSlot* slot = ::new (&slots[i]) SpinSlot();
+      S_LOCK_INIT(&slot->lock);
+    }
+  }
+
+  slots_ = slots;
+}
+
+void SpinManager::acquire(LockId lockid) {
+  SpinSlot* slot = &slots_[lockid];
+
+  if (tas(&slot->lock)) {
+    unsigned int ndelays = slock(&slot->lock, __FILE__, __LINE__, lockid);
+    slot->ndelays.store(slot->ndelays.load(std::memory_order_relaxed) + ndelays,
+                        std::memory_order_relaxed);
+  }
+
+  // We hold the lock, so a plain load and store do; no need for a locked
+  // read-modify-write.
+  slot->nacquires.store(slot->nacquires.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_relaxed);
+  LockStats::count_acquire(lockid, &slot->lock);
+}
+
+void SpinManager::release(LockId lockid) { S_UNLOCK(&slots_[lockid].lock); }
+
+SpinLockStats SpinManager::stats(LockId lockid) const {
+  const SpinSlot* slot = &slots_[lockid];
+
+  return {slot->nacquires.load(std::memory_order_relaxed),
+          slot->ndelays.load(std::memory_order_relaxed)};
+}
+
+}  // namespace rdbms
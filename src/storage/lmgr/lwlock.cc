@@ -0,0 +1,303 @@
+#include <cassert>
+#include <new>
+#include <thread>
+
+#include "rdbms/storage/lwlock.hpp"
+
+#include "rdbms/utils/globals.hpp"
+
+namespace rdbms {
+
+namespace {
+
+thread_local LWLockWaiter* my_waiter = nullptr;
+
+}  // namespace
+
+void LWLock::set_my_waiter(LWLockWaiter* waiter) { my_waiter = waiter; }
+
+bool LWLock::acquire(LWLockMode mode) {
+  bool result = true;
+  int extra_waits = 0;
+
+  // Being cancelled while holding the lock would leave it held.
+  g_interrupt_hold_off_count++;
+
+  while (true) {
+    if (!attempt_lock(mode)) {
+      break;
+    }
+
+    // Queue ourselves, then try again: the holder may have released the
+    // lock before it could see us on the queue, in which case nobody would
+    // wake us up.
+    queue_self(mode);
+
+    if (!attempt_lock(mode)) {
+      dequeue_self(&extra_waits);
+      break;
+    }
+
+    // Wait to be woken up. Wakeups meant for something else are counted and
+    // passed on once we hold the lock.
+    while (true) {
+      my_waiter->sema.acquire(false);
+
+      if (!my_waiter->waiting.load(std::memory_order_acquire)) {
+        break;
+      }
+
+      extra_waits++;
+    }
+
+    // We were the one woken up; let the next release wake up others again.
+    state_.fetch_or(kFlagReleaseOk, std::memory_order_relaxed);
+    result = false;
+  }
+
+  while (extra_waits-- > 0) {
+    my_waiter->sema.release();
+  }
+
+  return result;
+}
+
+bool LWLock::try_acquire(LWLockMode mode) {
+  g_interrupt_hold_off_count++;
+
+  if (attempt_lock(mode)) {
+    g_interrupt_hold_off_count--;
+
+    return false;
+  }
+
+  return true;
+}
+
+void LWLock::release() {
+  // Nobody can take the exclusive bit while we hold the lock in either mode,
+  // so it tells which mode we hold it in.
+  u32 value = held_exclusive() ? kValExclusive : kValShared;
+  u32 old_state = state_.fetch_sub(value, std::memory_order_release);
+  u32 new_state = old_state - value;
+
+  if ((new_state & (kFlagHasWaiters | kFlagReleaseOk)) ==
+          (kFlagHasWaiters | kFlagReleaseOk) &&
+      (new_state & kLockMask) == 0) {
+    wakeup();
+  }
+
+  g_interrupt_hold_off_count--;
+}
+
+bool LWLock::attempt_lock(LWLockMode mode) {
+  u32 old_state = state_.load(std::memory_order_relaxed);
+
+  while (true) {
+    u32 desired = old_state;
+    bool lock_free;
+
+    if (mode == LWLockMode::kExclusive) {
+      lock_free = (old_state & kLockMask) == 0;
+
+      if (lock_free) {
+        desired += kValExclusive;
+      }
+    } else {
+      lock_free = (old_state & kValExclusive) == 0;
+
+      if (lock_free) {
+        desired += kValShared;
+      }
+    }
+
+    // Swap in the old state even if the lock is taken: that tells us the
+    // state we decided on is still current.
+    if (state_.compare_exchange_weak(old_state, desired,
+                                     std::memory_order_acquire,
+                                     std::memory_order_relaxed)) {
+      return !lock_free;
+    }
+  }
+}
+
+void LWLock::lock_wait_list() {
+  int spins = 0;
+
+  while (state_.fetch_or(kFlagLocked, std::memory_order_acquire) &
+         kFlagLocked) {
+    while (state_.load(std::memory_order_relaxed) & kFlagLocked) {
+      if (++spins % 100 == 0) {
+        std::this_thread::yield();
+      }
+    }
+  }
+}
+
+void LWLock::unlock_wait_list() {
+  state_.fetch_and(~kFlagLocked, std::memory_order_release);
+}
+
+void LWLock::queue_self(LWLockMode mode) {
+  assert(my_waiter != nullptr);
+  assert(!my_waiter->waiting.load(std::memory_order_relaxed));
+
+  lock_wait_list();
+  state_.fetch_or(kFlagHasWaiters, std::memory_order_relaxed);
+
+  my_waiter->waiting.store(true, std::memory_order_relaxed);
+  my_waiter->wait_mode = mode;
+  my_waiter->next = nullptr;
+
+  if (tail_ != nullptr) {
+    tail_->next = my_waiter;
+  } else {
+    head_ = my_waiter;
+  }
+
+  tail_ = my_waiter;
+  unlock_wait_list();
+}
+
+void LWLock::dequeue_self(int* extra_waits) {
+  LWLockWaiter* prev = nullptr;
+  bool found = false;
+
+  lock_wait_list();
+
+  for (LWLockWaiter* cur = head_; cur != nullptr; cur = cur->next) {
+    if (cur == my_waiter) {
+      (prev != nullptr ? prev->next : head_) = cur->next;
+
+      if (tail_ == cur) {
+        tail_ = prev;
+      }
+
+      found = true;
+      break;
+    }
+
+    prev = cur;
+  }
+
+  if (head_ == nullptr) {
+    state_.fetch_and(~kFlagHasWaiters, std::memory_order_relaxed);
+  }
+
+  unlock_wait_list();
+
+  if (found) {
+    my_waiter->waiting.store(false, std::memory_order_relaxed);
+    my_waiter->next = nullptr;
+
+    return;
+  }
+
+  // Somebody dequeued us already and has woken us up, or is about to. That
+  // wakeup cleared kFlagReleaseOk on our behalf, so set it again, and
+  // absorb the wakeup so it does not end a later wait prematurely.
+  state_.fetch_or(kFlagReleaseOk, std::memory_order_relaxed);
+
+  while (true) {
+    my_waiter->sema.acquire(false);
+
+    if (!my_waiter->waiting.load(std::memory_order_acquire)) {
+      break;
+    }
+
+    (*extra_waits)++;
+  }
+}
+
+void LWLock::wakeup() {
+  LWLockWaiter* wake_head = nullptr;
+  LWLockWaiter* wake_tail = nullptr;
+  LWLockWaiter* prev = nullptr;
+  bool woke_somebody = false;
+
+  lock_wait_list();
+
+  // Wake up the first waiter if it wants the lock exclusively, otherwise
+  // every shared waiter in the queue.
+  for (LWLockWaiter* cur = head_; cur != nullptr;) {
+    LWLockWaiter* next = cur->next;
+
+    if (woke_somebody && cur->wait_mode == LWLockMode::kExclusive) {
+      prev = cur;
+      cur = next;
+      continue;
+    }
+
+    (prev != nullptr ? prev->next : head_) = next;
+
+    if (tail_ == cur) {
+      tail_ = prev;
+    }
+
+    cur->next = nullptr;
+    (wake_tail != nullptr ? wake_tail->next : wake_head) = cur;
+    wake_tail = cur;
+    woke_somebody = true;
+
+    if (cur->wait_mode == LWLockMode::kExclusive) {
+      break;
+    }
+
+    cur = next;
+  }
+
+  // Until the woken up processes got to run, later releases must not wake
+  // up anybody else; that would only make them fight over the lock.
+  u32 old_state = state_.load(std::memory_order_relaxed);
+
+  while (true) {
+    u32 desired = old_state & ~kFlagLocked;
+
+    if (woke_somebody) {
+      desired &= ~kFlagReleaseOk;
+    } else {
+      desired |= kFlagReleaseOk;
+    }
+
+    if (head_ == nullptr) {
+      desired &= ~kFlagHasWaiters;
+    }
+
+    if (state_.compare_exchange_weak(old_state, desired,
+                                     std::memory_order_release,
+                                     std::memory_order_relaxed)) {
+      break;
+    }
+  }
+
+  // A waiter may queue itself again as soon as `waiting` is cleared, so get
+  // the next one before.
+  for (LWLockWaiter* waiter = wake_head; waiter != nullptr;) {
+    LWLockWaiter* next = waiter->next;
+
+    waiter->next = nullptr;
+    waiter->waiting.store(false, std::memory_order_release);
+    waiter->sema.release();
+    waiter = next;
+  }
+}
+
+LWLockManager::LWLockManager(ShmemAllocator* shmem) : locks_(nullptr) {
+  bool found;
+  auto locks = static_cast<LWLockPadded*>(shmem->init_struct(
+      "LWLocks", sizeof(LWLockPadded) * kMaxSpins, &found));
+
+  if (locks == nullptr) {
+    return;
+  }
+
+  if (!found) {
+    for (int i = 0; i < kMaxSpins; i++) {
+      ::new (&locks[i]) LWLockPadded();
+    }
+  }
+
+  locks_ = locks;
+}
+
+}  // namespace rdbms
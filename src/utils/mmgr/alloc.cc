@@ -1,18 +1,396 @@
+#include <atomic>
+#include <bit>
 #include <cstddef>
+#include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <mutex>
 
 #include "rdbms/utils/alloc.hpp"
 
+#include <sys/mman.h>
+
 using namespace rdbms;
 
-#define HEADER_ALIGN()    MAX_ALIGN(sizeof(Size))
-#define HEADER_SIZE(base) *reinterpret_cast<Size*>(base)
+#define HEADER_ALIGN()    MAX_ALIGN(sizeof(BlockHeader))
+#define HEADER_SIZE(base) reinterpret_cast<BlockHeader*>(base)->size
+#define HEADER_KIND(base) reinterpret_cast<BlockHeader*>(base)->kind
 #define GET_POINTER(base) (static_cast<Pointer>(base) + HEADER_ALIGN())
 #define GET_BASE(ptr)     (static_cast<Pointer>(ptr) - HEADER_ALIGN())
 
-Size MemoryPool::bytes_allocated_ = 0;
+namespace {
+
+// Where the memory of a block comes from.
+enum class BlockKind : Size {
+  kMalloc,    // malloc(), may be cached
+  kHugeTlb,   // mmap() with MAP_HUGETLB
+  kMadvised,  // mmap() of regular pages, madvise()d for transparent huge pages
+};
+
+// Hidden header in front of every block. Its size is MAX_ALIGN(sizeof(Size))
+// on common platforms anyway, so the kind comes for free.
+struct BlockHeader {
+  Size size;       // Usable size of the block
+  BlockKind kind;  // How to release the block
+};
+
+// A cached block is linked into its size class through its own data area,
+// which is at least MemoryPool::kMinCachedSize bytes.
+struct CachedBlock {
+  CachedBlock* prev;
+  CachedBlock* next;
+};
+
+// Per-thread cache of freed blocks, see MemoryPool. Size class k holds blocks
+// whose capacity is in [2^k, 2^(k+1)).
+class BlockCache {
+ public:
+  ~BlockCache() {
+    trim(0);
+
+    // Nothing may be cached anymore, should a later destructor free memory.
+    max_bytes_ = 0;
+  }
+
+  // Take a block with room for `nbytes`, but no more than `max_capacity`, out
+  // of the cache. Return nullptr if there is none.
+  void* get(Size nbytes, Size max_capacity) {
+    if (nbytes < MemoryPool::kMinCachedSize || max_bytes_ == 0) {
+      return nullptr;
+    }
+
+    int k = size_class(nbytes);
+
+    // Blocks in class k may still be too small, so look at a few of them.
+    // Any block in class k + 1 is big enough.
+    CachedBlock* block = classes_[k].head;
+
+    for (int i = 0; block != nullptr && i < kMaxProbes; i++) {
+      if (capacity(block) >= nbytes) {
+        break;
+      }
+
+      block = block->next;
+    }
+
+    if (block == nullptr || capacity(block) < nbytes) {
+      block = k + 1 < kNumClasses ? classes_[++k].head : nullptr;
+    }
+
+    if (block == nullptr || capacity(block) < nbytes ||
+        capacity(block) > max_capacity) {
+      stats_.misses++;
+
+      return nullptr;
+    }
+
+    unlink(k, block);
+    stats_.hits++;
+
+    return block;
+  }
+
+  // Park the given block in the cache. Return false if it does not qualify,
+  // in which case the caller frees it.
+  bool put(void* ptr) {
+    Size nbytes = HEADER_SIZE(GET_BASE(ptr));
+
+    if (nbytes < MemoryPool::kMinCachedSize || nbytes > max_bytes_ ||
+        max_blocks_per_class_ == 0) {
+      return false;
+    }
+
+    int k = size_class(nbytes);
+
+    if (classes_[k].nblocks == max_blocks_per_class_) {
+      release(k, classes_[k].tail);
+    }
+
+    if (stats_.cached_bytes + nbytes > max_bytes_) {
+      trim(max_bytes_ - nbytes);
+    }
+
+    auto block = static_cast<CachedBlock*>(ptr);
+    SizeClass& sc = classes_[k];
+
+    block->prev = nullptr;
+    block->next = sc.head;
+
+    if (sc.head != nullptr) {
+      sc.head->prev = block;
+    } else {
+      sc.tail = block;
+    }
+
+    sc.head = block;
+    sc.nblocks++;
+    stats_.cached_blocks++;
+    stats_.cached_bytes += nbytes;
+
+    return true;
+  }
+
+  // Free cached blocks, largest size classes and least recently cached blocks
+  // first, until at most `max_bytes` remain in the cache.
+  void trim(Size max_bytes) {
+    for (int k = kNumClasses - 1; k >= 0; k--) {
+      while (stats_.cached_bytes > max_bytes && classes_[k].tail != nullptr) {
+        release(k, classes_[k].tail);
+      }
+    }
+  }
+
+  void set_limits(Size max_bytes, Size max_blocks_per_class) {
+    max_bytes_ = max_bytes;
+    max_blocks_per_class_ = max_blocks_per_class;
+
+    for (int k = 0; k < kNumClasses; k++) {
+      while (classes_[k].nblocks > max_blocks_per_class_) {
+        release(k, classes_[k].tail);
+      }
+    }
+
+    trim(max_bytes_);
+  }
+
+  BlockCacheStats stats() const { return stats_; }
+
+ private:
+  static constexpr int kMinClass =
+      std::bit_width(MemoryPool::kMinCachedSize) - 1;
+  static constexpr int kNumClasses = 64 - kMinClass;
+  static constexpr int kMaxProbes = 4;
+
+  struct SizeClass {
+    CachedBlock* head;
+    CachedBlock* tail;
+    Size nblocks;
+  };
+
+  static int size_class(Size nbytes) {
+    return std::bit_width(nbytes) - 1 - kMinClass;
+  }
+
+  static Size capacity(CachedBlock* block) {
+    return HEADER_SIZE(GET_BASE(static_cast<void*>(block)));
+  }
+
+  void unlink(int k, CachedBlock* block) {
+    SizeClass& sc = classes_[k];
+
+    if (block->prev != nullptr) {
+      block->prev->next = block->next;
+    } else {
+      sc.head = block->next;
+    }
+
+    if (block->next != nullptr) {
+      block->next->prev = block->prev;
+    } else {
+      sc.tail = block->prev;
+    }
+
+    sc.nblocks--;
+    stats_.cached_blocks--;
+    stats_.cached_bytes -= capacity(block);
+  }
+
+  void release(int k, CachedBlock* block) {
+    unlink(k, block);
+    stats_.trims++;
+    ::free(GET_BASE(static_cast<void*>(block)));
+  }
+
+  SizeClass classes_[kNumClasses]{};
+  Size max_bytes_ = MemoryPool::kDefaultCacheBytes;
+  Size max_blocks_per_class_ = MemoryPool::kDefaultCacheBlocksPerClass;
+  BlockCacheStats stats_{};
+};
+
+thread_local BlockCache block_cache;
+
+// Bytes allocated through MemoryPool by one thread. Only the owning thread
+// writes the counter, so a plain load and store is enough and the cache line
+// is never contended; other threads merely read it when aggregating. A block
+// may be freed by a different thread than the one that allocated it, which is
+// why the counter is signed: only the sum over all threads is meaningful.
+class ThreadCounter {
+ public:
+  ThreadCounter();
+  ~ThreadCounter();
+
+  void add(std::int64_t nbytes) {
+    bytes_.store(bytes_.load(std::memory_order_relaxed) + nbytes,
+                 std::memory_order_relaxed);
+  }
+
+  std::int64_t bytes() const { return bytes_.load(std::memory_order_relaxed); }
+
+ private:
+  friend class CounterRegistry;
+
+  std::atomic<std::int64_t> bytes_{0};
+  ThreadCounter* prev_ = nullptr;
+  ThreadCounter* next_ = nullptr;
+};
+
+// All live thread counters, plus what exited threads left behind. The mutex
+// is only taken on thread start and exit and when the total is asked for.
+class CounterRegistry {
+ public:
+  void enroll(ThreadCounter* counter) {
+    std::lock_guard<std::mutex> guard(mutex_);
+
+    counter->next_ = head_;
+
+    if (head_ != nullptr) {
+      head_->prev_ = counter;
+    }
+
+    head_ = counter;
+  }
+
+  void retire(ThreadCounter* counter) {
+    std::lock_guard<std::mutex> guard(mutex_);
+
+    if (counter->prev_ != nullptr) {
+      counter->prev_->next_ = counter->next_;
+    } else {
+      head_ = counter->next_;
+    }
+
+    if (counter->next_ != nullptr) {
+      counter->next_->prev_ = counter->prev_;
+    }
+
+    retired_bytes_ += counter->bytes();
+  }
+
+  std::int64_t total() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    std::int64_t total = retired_bytes_;
+
+    for (ThreadCounter* counter = head_; counter != nullptr;
+         counter = counter->next_) {
+      total += counter->bytes();
+    }
+
+    return total;
+  }
+
+ private:
+  std::mutex mutex_;
+  ThreadCounter* head_ = nullptr;
+  std::int64_t retired_bytes_ = 0;
+};
+
+// Threads may still exit after static destructors ran, so the registry is
+// never destroyed.
+CounterRegistry& counter_registry() {
+  static auto registry = new CounterRegistry;
+
+  return *registry;
+}
+
+ThreadCounter::ThreadCounter() { counter_registry().enroll(this); }
+
+ThreadCounter::~ThreadCounter() { counter_registry().retire(this); }
+
+thread_local ThreadCounter thread_counter;
+
+// Blocks at least this big may come from huge pages, see allocate_huge().
+// 0 stands for the huge page size.
+std::atomic<Size> huge_threshold{0};
+std::atomic<Size> hugetlb_pages{0};
+std::atomic<Size> madvised_pages{0};
+std::atomic<Size> hugetlb_fallbacks{0};
+
+// Set once MAP_HUGETLB has failed. Most hosts reserve no huge pages at all,
+// so don't pay a failing mmap() for every block; try again only once a
+// MAP_HUGETLB block is given back and its pages are free again.
+std::atomic<bool> hugetlb_exhausted{false};
+
+// Map `size` bytes, a multiple of the huge page size, at a huge page
+// boundary. Try reserved huge pages first; if there are none, map regular
+// pages and ask for transparent huge pages instead.
+void* map_huge(Size size, BlockKind* kind) {
+  Size page_size = MemoryPool::huge_page_size();
+
+#ifdef MAP_HUGETLB
+  if (!hugetlb_exhausted.load(std::memory_order_relaxed)) {
+    void* base = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+    if (base != MAP_FAILED) {
+      *kind = BlockKind::kHugeTlb;
+      hugetlb_pages += size / page_size;
+
+      return base;
+    }
+
+    hugetlb_exhausted.store(true, std::memory_order_relaxed);
+  }
+
+  hugetlb_fallbacks++;
+#endif
+
+  // The kernel only backs huge page aligned ranges with huge pages, so map
+  // one page more than needed and cut off the ends.
+  void* raw = ::mmap(nullptr, size + page_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if (raw == MAP_FAILED) {
+    return nullptr;
+  }
+
+  auto start = reinterpret_cast<std::uintptr_t>(raw);
+  auto aligned = TYPE_ALIGN(page_size, start);
+
+  if (aligned > start) {
+    ::munmap(raw, aligned - start);
+  }
+
+  if (Size tail = page_size - (aligned - start); tail > 0) {
+    ::munmap(reinterpret_cast<void*>(aligned + size), tail);
+  }
+
+  auto base = reinterpret_cast<void*>(aligned);
+
+#ifdef MADV_HUGEPAGE
+  ::madvise(base, size, MADV_HUGEPAGE);
+#endif
+
+  *kind = BlockKind::kMadvised;
+  madvised_pages += size / page_size;
+
+  return base;
+}
+
+void unmap_huge(void* base) {
+  Size size = HEADER_SIZE(base) + HEADER_ALIGN();
+  Size npages = size / MemoryPool::huge_page_size();
+
+  if (HEADER_KIND(base) == BlockKind::kHugeTlb) {
+    hugetlb_pages -= npages;
+    hugetlb_exhausted.store(false, std::memory_order_relaxed);
+  } else {
+    madvised_pages -= npages;
+  }
+
+  ::munmap(base, size);
+}
+
+}  // namespace
+
+Memory MemoryPool::allocate(std::size_t nbytes, std::size_t max_capacity) {
+  if (void* ptr = block_cache.get(nbytes, max_capacity); ptr != nullptr) {
+    Size capacity = HEADER_SIZE(GET_BASE(ptr));
+    thread_counter.add(capacity);
+
+    return {ptr, capacity};
+  }
 
-Memory MemoryPool::allocate(std::size_t nbytes) {
   Size size = recommend_size(nbytes);
   void* base = ::malloc(size);
 
@@ -21,12 +399,36 @@ Memory MemoryPool::allocate(std::size_t nbytes) {
     return {nullptr, 0};
   }
 
-  bytes_allocated_ += nbytes;
+  thread_counter.add(nbytes);
   HEADER_SIZE(base) = nbytes;
+  HEADER_KIND(base) = BlockKind::kMalloc;
 
   return {GET_POINTER(base), nbytes};
 }
 
+Memory MemoryPool::allocate_huge(Size nbytes, Size max_capacity) {
+  Size size = TYPE_ALIGN(huge_page_size(), recommend_size(nbytes));
+
+  if (recommend_size(nbytes) < huge_page_threshold() ||
+      size - HEADER_ALIGN() > max_capacity) {
+    return allocate(nbytes, max_capacity);
+  }
+
+  BlockKind kind;
+  void* base = map_huge(size, &kind);
+
+  if (base == nullptr) {
+    return allocate(nbytes, max_capacity);
+  }
+
+  Size capacity = size - HEADER_ALIGN();
+  thread_counter.add(capacity);
+  HEADER_SIZE(base) = capacity;
+  HEADER_KIND(base) = kind;
+
+  return {GET_POINTER(base), capacity};
+}
+
 // If ptr is NULL, realloc() is identical to a call
 // to malloc() for size bytes. If size is zero and ptr is not NULL, a new,
 // minimum sized object is allocated and the original object is freed. When
@@ -41,16 +443,106 @@ Memory MemoryPool::reallocate(void* ptr, std::size_t nbytes) {
   Size size = recommend_size(nbytes);
   Size old_size = HEADER_SIZE(base);
 
-  bytes_allocated_ += (nbytes - old_size);
+  // A block that came from the cache may already be big enough.
+  if (old_size >= nbytes) {
+    return {ptr, old_size};
+  }
+
+  // Mappings cannot be resized by realloc(), so move the data to a new block
+  // of the same kind.
+  if (HEADER_KIND(base) != BlockKind::kMalloc) {
+    Memory mem = allocate_huge(nbytes);
+
+    if (mem.ptr != nullptr) {
+      std::memcpy(mem.ptr, ptr, old_size);
+      deallocate(ptr);
+    }
+
+    return mem;
+  }
+
+  void* new_base = ::realloc(base, size);
+
+  // TODO(gc): add log
+  if (new_base == nullptr) {
+    return {nullptr, 0};
+  }
+
+  thread_counter.add(nbytes - old_size);
+  HEADER_SIZE(new_base) = nbytes;
 
-  return {::realloc(base, size), nbytes};
+  return {GET_POINTER(new_base), nbytes};
 }
 
 void MemoryPool::deallocate(void* ptr) {
+  if (ptr == nullptr) {
+    return;
+  }
+
   Pointer base = GET_BASE(ptr);
-  bytes_allocated_ -= HEADER_SIZE(base);
+  thread_counter.add(-static_cast<std::int64_t>(HEADER_SIZE(base)));
 
-  ::free(base);
+  if (HEADER_KIND(base) != BlockKind::kMalloc) {
+    unmap_huge(base);
+  } else if (!block_cache.put(ptr)) {
+    ::free(base);
+  }
+}
+
+Size MemoryPool::capacity(const void* ptr) {
+  return HEADER_SIZE(GET_BASE(const_cast<void*>(ptr)));
 }
 
+Size MemoryPool::bytes_allocated() { return counter_registry().total(); }
+
+std::int64_t MemoryPool::thread_bytes_allocated() {
+  return thread_counter.bytes();
+}
+
+Size MemoryPool::huge_page_size() {
+  static const Size size = [] {
+    Size size = 2 * 1024 * 1024;
+
+    if (FILE* fp = fopen("/proc/meminfo", "r"); fp != nullptr) {
+      char line[128];
+      unsigned long kb;
+
+      while (fgets(line, sizeof line, fp) != nullptr) {
+        if (sscanf(line, "Hugepagesize: %lu kB", &kb) == 1) {
+          size = kb * 1024;
+          break;
+        }
+      }
+
+      fclose(fp);
+    }
+
+    return size;
+  }();
+
+  return size;
+}
+
+void MemoryPool::set_huge_page_threshold(Size nbytes) {
+  huge_threshold = nbytes;
+}
+
+Size MemoryPool::huge_page_threshold() {
+  Size threshold = huge_threshold;
+
+  return threshold != 0 ? threshold : huge_page_size();
+}
+
+HugePageStats MemoryPool::huge_page_stats() {
+  return {hugetlb_pages, madvised_pages, hugetlb_fallbacks};
+}
+
+void MemoryPool::set_cache_limits(Size max_bytes, Size max_blocks_per_class) {
+  block_cache.set_limits(max_bytes, max_blocks_per_class);
+}
+
+void MemoryPool::trim_cache() { block_cache.trim(0); }
+
+BlockCacheStats MemoryPool::cache_stats() { return block_cache.stats(); }
+
 Size MemoryPool::recommend_size(Size nbytes) { return HEADER_ALIGN() + nbytes; }
@@ -1,11 +1,11 @@
 #include <algorithm>
 #include <cassert>
 #include <cstdlib>
+#include <cstring>
 
 #include "rdbms/utils/aset.hpp"
 
 #include "rdbms/utils/elog.hpp"
-#include <numeric>
 
 namespace rdbms {
 
@@ -15,45 +15,56 @@ void AllocBlockData::memory_check() {
   AllocSet set = static_cast<AllocSet>(aset());
   const char* name = set->name().c_str();
 
-  while (start != end) {
+  while (start < end) {
     AllocChunk chunk = reinterpret_cast<AllocChunk>(start);
-    Size chunk_size = chunk->size();
-    Size data_size = chunk->requested_size();
 
-    // Check chunk size.
-    if (data_size > chunk_size) {
-      elog(NOTICE,
-           "%s: %s: requested size > allocated size for chunk %p in block %p",
-           __func__, name, chunk, this);
+    // Check the block offset before trusting anything derived from it.
+    if (chunk->block() != this) {
+      elog(NOTICE, "%s: %s: bogus block link in block %p, chunk %p", __func__,
+           name, this, chunk);
+      return;
     }
 
-    if (chunk_size < (1 << AllocSetContext::kMinBits)) {
-      elog(NOTICE, "%s: %s: bad size %lu for chunk %p in block %p", name,
-           chunk_size, chunk, this);
+    int fidx = chunk->free_index();
+
+    if (fidx >= AllocSetContext::kNumFreeLists &&
+        fidx != AllocChunkData::kLargeIndex) {
+      elog(NOTICE, "%s: %s: bad freelist index %d for chunk %p in block %p",
+           __func__, name, fidx, chunk, this);
+      return;
     }
 
     // Single chunk block.
-    if (chunk_size > AllocSetContext::kChunkLimit &&
-        static_cast<void*>(chunk) != start) {
+    if (chunk->is_large() && static_cast<void*>(chunk) != data()) {
       elog(NOTICE, "%s: %s: bad single-chunk %p in block %p", __func__, name,
            chunk, this);
     }
 
-    // If chunk is allocated, check for correct aset pointer. (If
-    // it's free, the aset is the freelist pointer, which we can't
-    // check as easily...)
-    if (data_size > 0 && chunk->next() != static_cast<void*>(set)) {
-      elog(NOTICE, "%s: %s: bogus aset link in block %p, chunk %p", __func__,
-           name, this, chunk);
+#if MEMORY_CONTEXT_CHECKING
+    Size chunk_size = chunk->size();
+    Size data_size = chunk->requested_size();
+
+    // Check chunk size.
+    if (data_size > chunk_size) {
+      elog(NOTICE,
+           "%s: %s: requested size > allocated size for chunk %p in block %p",
+           __func__, name, chunk, this);
     }
 
-    if (!chunk->memory_boundary_check()) {
+    // Free chunks are clobbered, so only allocated ones carry the marker.
+    if (!chunk->is_free() && !chunk->memory_boundary_check()) {
       elog(NOTICE,
            "%s: %s: detected write past chunk end in block %p, chunk %p",
            __func__, name, this, chunk);
     }
+#endif
 
-    start += chunk_size + kChunkHdrSz;
+    start += chunk->size() + kChunkHdrSz;
+  }
+
+  if (start != end) {
+    elog(NOTICE, "%s: %s: chunks overrun free pointer in block %p", __func__,
+         name, this);
   }
 }
 
@@ -71,31 +82,35 @@ AllocSetContext::AllocSetContext(MemoryContext parent, std::string name,
 
   if (min_context_size > kBlockHdrSz + kChunkHdrSz) {
     Size blk_size = MAX_ALIGN(min_context_size);
-    Memory mem = MemoryPool::allocate(blk_size);
-    keeper_ = ::new (AllocBlockData)(this, mem);
+    Memory mem = allocate_block(blk_size);
+
+    if (mem.ptr != nullptr) {
+      keeper_ = ::new (mem.ptr) AllocBlockData(this, mem);
+      blocks_.push_front(keeper_);
+    }
   }
 }
 
 void* AllocSetContext::alloc(Size size) {
+  return run_pending_spills(alloc_chunk(size));
+}
+
+void* AllocSetContext::alloc_chunk(Size size) {
   // If requested size exceeds maximum for chunks, allocate an entire
   // block for this request.
   if (size > kChunkLimit) {
     auto chunk = this->alloc_large_chunk(size);
 
-    assert(chunk != nullptr);
-
-    return chunk->data();
+    return chunk != nullptr ? profile_alloc(chunk->data(), size) : nullptr;
   }
 
   if (auto chunk = try_alloc_from_freelist(size); chunk != nullptr) {
-    return chunk->data();
+    return profile_alloc(chunk->data(), size);
   }
 
   auto chunk = alloc_from_block(size);
 
-  assert(chunk != nullptr);
-
-  return chunk->data();
+  return chunk != nullptr ? profile_alloc(chunk->data(), size) : nullptr;
 }
 
 void AllocSetContext::free(void* ptr) {
@@ -104,9 +119,10 @@ void AllocSetContext::free(void* ptr) {
   }
 
   AllocChunk chunk = AllocChunkData::cast_ptr(ptr);
-  assert(static_cast<void*>(chunk->next()) == this);
+  assert(!chunk->is_free() && chunk->aset() == this);
+  profile_free(ptr);
 
-  if (chunk->size() > kChunkLimit) {
+  if (chunk->is_large()) {
     this->free_large_chunk(chunk);
   } else {
     return_chunk_to_freelist(chunk);
@@ -114,12 +130,16 @@ void AllocSetContext::free(void* ptr) {
 }
 
 void* AllocSetContext::realloc(void* ptr, Size size) {
+  if (ptr == nullptr) {
+    return alloc(size);
+  }
+
   AllocChunk chunk = AllocChunkData::cast_ptr(ptr);
 
   if (!chunk->memory_boundary_check()) {
     // TODO(gc): fix later
     fprintf(stderr, "%s: detected write past chunk end in %s %p", __func__,
-            name_, chunk);
+            name_.c_str(), chunk);
     exit(1);
   }
 
@@ -134,47 +154,109 @@ void* AllocSetContext::realloc(void* ptr, Size size) {
     return ptr;
   }
 
-  if (old_size > kChunkLimit) {
-    void* block = static_cast<Pointer>(static_cast<void*>(chunk)) - kBlockHdrSz;
+  if (chunk->is_large()) {
+    AllocBlock block = large_chunk_block(chunk);
+
+    Size blk_size = kBlockHdrSz + kChunkHdrSz + MAX_ALIGN(size);
 
-    if (!blocks_.remove(block)) {
-      fprintf(stderr, "%s: cannot find block containing chunk %p\n", __func__,
-              chunk);
-      exit(1);
+    // The block header records its neighbours, so unlinking it is O(1).
+    // realloc may move the block, so it must be off the list first.
+    blocks_.remove(block);
+    Memory mem = reallocate_block(block, blk_size);
+
+    if (mem.ptr == nullptr) {
+      blocks_.enqueue(block);
+
+      return run_pending_spills(nullptr);
     }
 
-    Size chunk_size = MAX_ALIGN(size);
-    Size blk_size = kBlockHdrSz + kChunkHdrSz + chunk_size;
-    Memory mem = MemoryPool::reallocate(block, blk_size);
-    auto new_block = ::new (AllocBlockData)(this, mem);
-    chunk = new_block->fetch_chunk(chunk_size, size);
+    auto new_block = ::new (mem.ptr) AllocBlockData(this, mem);
+    chunk = new_block->fetch_large_chunk(size);
     blocks_.enqueue(new_block);
+    profile_free(ptr);
 
-    return chunk->data();
-  } else {
-    return_chunk_to_freelist(chunk);
+    return run_pending_spills(profile_alloc(chunk->data(), size));
+  }
 
-    return alloc(size);
+  // A small chunk that was the last one carved from the active block can
+  // simply take more of the block. Buffers that keep doubling, like string
+  // builders, hit this case all the time.
+  if (size <= kChunkLimit && try_grow_in_place(chunk, size)) {
+    return ptr;
+  }
+
+  // Otherwise, move the data to a new chunk. Allocate before freeing, so
+  // the old chunk is left alone if we run out of memory.
+  void* new_ptr = alloc_chunk(size);
+
+  if (new_ptr == nullptr) {
+    return run_pending_spills(nullptr);
   }
+
+  std::memcpy(new_ptr, ptr, old_size);
+  profile_free(ptr);
+  return_chunk_to_freelist(chunk);
+
+  return run_pending_spills(new_ptr);
 }
 
 void AllocSetContext::reset() {
+  check_not_spilling();
+  profile_reset();
   std::memset(freelist_, 0, sizeof freelist_);
 
-  for (auto block : blocks_) {
-    MemoryPool::deallocate(block);
+  // Gather every block but the keeper on the retained list.
+  for (auto iter = blocks_.begin(); iter != blocks_.end();) {
+    AllocBlock block = *iter++;
+
+    if (block != keeper_) {
+      block->reset();
+      retained_.push_front(block);
+    }
   }
 
   blocks_.reset();
 
+  // Retain the largest blocks that fit in the budget and release the rest.
+  retained_.sort_by_size();
+
+  Size budget = retained_limit_;
+  bool clean = true;
+
+  for (auto iter = retained_.begin(); iter != retained_.end();) {
+    AllocBlock block = *iter++;
+
+    if (block->size() <= budget) {
+      budget -= block->size();
+    } else {
+      retained_.remove(block);
+      deallocate_block(block);
+      clean = false;
+    }
+  }
+
   if (keeper_ != nullptr) {
     keeper_->reset();
+    blocks_.push_front(keeper_);
   }
+
+  retention_stats_.resets++;
+  retention_stats_.clean_resets += clean;
 }
 
 void AllocSetContext::destroy() {
-  reset();
-  MemoryPool::deallocate(keeper_);
+  check_not_spilling();
+  profile_reset();
+  std::memset(freelist_, 0, sizeof freelist_);
+
+  for (auto list : {&blocks_, &retained_}) {
+    for (auto iter = list->begin(); iter != list->end();) {
+      deallocate_block(*iter++);
+    }
+
+    list->reset();
+  }
+
   keeper_ = nullptr;
 }
 
@@ -184,108 +266,100 @@ void AllocSetContext::check() {
   }
 }
 
-void AllocSetContext::stats() {
-  Size nblocks = blocks_.size();
-  Size total_space = std::accumulate(
-      blocks_.begin(), blocks_.end(), 0,
-      [](Size init, AllocBlock block) { return init + block->size(); });
-  Size free_space = std::accumulate(
-      blocks_.begin(), blocks_.end(), 0,
-      [](Size init, AllocBlock block) { return init + block->avail_space(); });
-
-  Size nchunks = 0;
+void AllocSetContext::count(MemoryContextCounters* counters) {
+  for (auto list : {&blocks_, &retained_}) {
+    for (auto block : *list) {
+      counters->nblocks++;
+      counters->total_space += block->size();
+      counters->free_space += block->avail_space();
+    }
+  }
 
   for (auto chunk : freelist_) {
     while (chunk != nullptr) {
-      nchunks++;
-      free_space += chunk->size() + kChunkHdrSz;
-      chunk = chunk->next();
+      counters->free_chunks++;
+      counters->free_space += chunk->size() + kChunkHdrSz;
+      chunk = chunk->next_free();
     }
   }
+}
 
-  if (keeper_ != nullptr) {
-    nblocks++;
-    total_space += keeper_->size();
-    free_space += keeper_->avail_space();
+BlockRetentionStats AllocSetContext::retention_stats() const {
+  BlockRetentionStats stats = retention_stats_;
+  stats.retained_bytes = 0;
+
+  for (auto block : const_cast<LinkedBlock&>(retained_)) {
+    stats.retained_bytes += block->size();
   }
 
-  fprintf(stderr,
-          "%s: %ld total in %ld blocks; %ld free (%ld chunks); %ld used\n",
-          name_.c_str(), total_space, nblocks, free_space, nchunks,
-          total_space - free_space);
+  return stats;
 }
 
 AllocChunk AllocSetContext::alloc_large_chunk(Size size) {
-  Size chunk_size = MAX_ALIGN(size);
-  Size blk_size = kBlockHdrSz + kChunkHdrSz + chunk_size;
+  Size blk_size = kBlockHdrSz + kChunkHdrSz + MAX_ALIGN(size);
+
+  Memory mem = allocate_block(blk_size);
 
-  Memory mem = MemoryPool::allocate(blk_size);
-  auto block = ::new (AllocBlockData)(this, mem);
+  if (mem.ptr == nullptr) {
+    return nullptr;
+  }
+
+  auto block = ::new (mem.ptr) AllocBlockData(this, mem);
+  auto chunk = block->fetch_large_chunk(size);
+
+  // The block is full now, even if MemoryPool handed out more than we asked
+  // for, so it goes behind the active head block and never gets in the way
+  // of small allocations.
   blocks_.enqueue(block);
 
-  return block->fetch_chunk(chunk_size, size);
+  return chunk;
 }
 
 AllocChunk AllocSetContext::try_alloc_from_freelist(Size size) {
-  AllocChunk chunk;
-  AllocChunk prior_free = nullptr;
-
   int fidx = free_index(size);
 
-  // Request is small enough to be treated as a chunk.  Look in the
-  // corresponding free list to see if there is a free chunk we could
-  // reuse.
-  for (chunk = freelist_[fidx]; chunk != nullptr; chunk = chunk->next()) {
-    if (chunk->size() >= size) {
-      break;
-    }
-
-    prior_free = chunk;
-  }
+  // Request is small enough to be treated as a chunk. All chunks on the
+  // corresponding free list have the same size, so any of them will do.
+  AllocChunk chunk = freelist_[fidx];
 
-  // If not found.
   if (chunk == nullptr) {
     return chunk;
   }
 
   // If one is found, remove it from the free list, make it again a
   // member of the alloc set and return its data address.
-  AllocChunk next = chunk->next();
+  freelist_[fidx] = chunk->next_free();
 
-  if (prior_free == nullptr) {
-    freelist_[fidx] = next;
-  } else {
-    prior_free->set_next(next);
-  }
-
-  chunk->set_next(this);
-
-  // In PostgreSQL version 7.1.3, this functionality is enabled by the
-  // MEMORY_CONTEXT_CHECKING macro. We opt for enabling it despite the
-  // efficiency loss, as it significantly enhances debuggability.
-  chunk->set_requested_size(size);
+  // Also marks the end of the chunk if MEMORY_CONTEXT_CHECKING is on.
+  chunk->mark_allocated(size);
 
   return chunk;
 }
 
 AllocChunk AllocSetContext::alloc_from_block(Size size) {
-  AllocBlock block = blocks_;
+  AllocBlock block = blocks_.head();
   int fidx = free_index(size);
-  Size chunk_size = 1 << (fidx + kMinBits);
+  Size chunk_size = Size{1} << (fidx + kMinBits);
 
   if (block != nullptr && block->avail_space() < (chunk_size + kChunkHdrSz)) {
     merge_block_remainder_to_chunk(block);
     block = nullptr;
   }
 
+  Size required_size = kBlockHdrSz + kChunkHdrSz + chunk_size;
+
+  if (block == nullptr) {
+    block = take_retained_block(required_size);
+  }
+
   if (block == nullptr) {
     Size blk_size;
 
     // TODO(gc): does this really makes sense?
-    if (blocks_ == nullptr) {
+    if (blocks_.head() == nullptr) {
       blk_size = init_block_size_;
     } else {
-      blk_size = blocks_->size();
+      blk_size = blocks_.head()->size();
 
       // Special case: if very first allocation was for a large
       // chunk (or we have a small "keeper" block), could have an
@@ -301,19 +375,38 @@ AllocChunk AllocSetContext::alloc_from_block(Size size) {
       }
     }
 
-    Size required_size = kBlockHdrSz + kChunkHdrSz + chunk_size;
-
     if (blk_size < required_size) {
       blk_size = required_size;
     }
 
-    Memory mem = MemoryPool::allocate(blk_size);
-    block = ::new (AllocBlockData)(this, mem);
-    block->set_next(blocks_);
-    blocks_ = block;
+    Memory mem = allocate_block(blk_size);
+
+    if (mem.ptr == nullptr) {
+      return nullptr;
+    }
+
+    block = ::new (mem.ptr) AllocBlockData(this, mem);
+    blocks_.push_front(block);
+    retention_stats_.new_blocks++;
   }
 
-  return block->fetch_chunk(chunk_size, size);
+  return block->fetch_chunk(fidx, size);
+}
+
+AllocBlock AllocSetContext::take_retained_block(Size required_size) {
+  // The head is the largest retained block, so if it is too small, they
+  // all are.
+  AllocBlock block = retained_.head();
+
+  if (block == nullptr || block->size() < required_size) {
+    return nullptr;
+  }
+
+  retained_.remove(block);
+  blocks_.push_front(block);
+  retention_stats_.reused_blocks++;
+
+  return block;
 }
 
 void AllocSetContext::merge_block_remainder_to_chunk(AllocBlock block) {
@@ -338,37 +431,68 @@ void AllocSetContext::merge_block_remainder_to_chunk(AllocBlock block) {
     // larger freelist than the one we need to put this chunk
     // on. The exception is when availchunk is exactly a
     // power of 2.
-    if (chunk_size != (1 << (fidx + kMinBits))) {
+    if (chunk_size != (Size{1} << (fidx + kMinBits))) {
       fidx--;
-      chunk_size = (1 << (fidx + kMinBits));
     }
 
-    auto chunk = block->fetch_chunk(chunk_size, 0);
+    auto chunk = block->fetch_chunk(fidx, 0);
     return_chunk_to_freelist(chunk);
     avail_space = block->avail_space();
   }
 }
 
+bool AllocSetContext::try_grow_in_place(AllocChunk chunk, Size size) {
+  AllocBlock block = blocks_.head();
+  auto chunk_end = static_cast<Pointer>(chunk->data()) + chunk->size();
+
+  if (block != chunk->block() || chunk_end != block->free_ptr()) {
+    return false;
+  }
+
+  int fidx = free_index(size);
+  Size growth = (Size{1} << (fidx + kMinBits)) - chunk->size();
+
+  if (block->avail_space() < growth) {
+    return false;
+  }
+
+  block->set_free_ptr(chunk_end + growth);
+  chunk->set_free_index(fidx);
+  chunk->set_requested_size(size);
+
+  return true;
+}
+
 void AllocSetContext::return_chunk_to_freelist(AllocChunk chunk) {
-  int fidx = free_index(chunk->size());
-  chunk->clear();
-  chunk->set_next(freelist_[fidx]);
+  int fidx = chunk->free_index();
+  chunk->mark_free();
+  chunk->set_next_free(freelist_[fidx]);
   freelist_[fidx] = chunk;
 }
 
 void AllocSetContext::free_large_chunk(AllocChunk chunk) {
   // Big chunks are certain to have been allocated as single-chunk
   // blocks. Find the containing block and return it to malloc().
-  void* block = static_cast<Pointer>(static_cast<void*>(chunk)) - kBlockHdrSz;
+  AllocBlock block = large_chunk_block(chunk);
+
+  blocks_.remove(block);
+  deallocate_block(block);
+}
+
+AllocBlock AllocSetContext::large_chunk_block(AllocChunk chunk) {
+  AllocBlock block = chunk->block();
 
-  if (!blocks_.remove(block)) {
+  // A large chunk is always the first and only chunk in its block, and the
+  // block must belong to us, since we are going to unlink it without
+  // searching the list.
+  if (block->aset() != this || block->data() != static_cast<void*>(chunk)) {
     // TODO(gc): fix later
     fprintf(stderr, "%s: cannot find block containing chunk %p\n", __func__,
             chunk);
     exit(1);
   }
 
-  MemoryPool::deallocate(block);
+  return block;
 }
 
-}  // namespace rdbms
\ No newline at end of file
+}  // namespace rdbms
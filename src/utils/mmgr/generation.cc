@@ -0,0 +1,302 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+#include "rdbms/utils/generation.hpp"
+
+#include "rdbms/utils/elog.hpp"
+
+namespace rdbms {
+
+GenerationContext::GenerationContext(MemoryContext parent, std::string name,
+                                     Size init_block_size,
+                                     Size max_block_size)
+    : MemoryContextData(kGenerationContext, parent, std::move(name)),
+      blocks_(nullptr),
+      block_(nullptr),
+      free_block_(nullptr) {
+  init_block_size = MAX_ALIGN(init_block_size);
+  max_block_size = MAX_ALIGN(max_block_size);
+
+  init_block_size_ = std::max({init_block_size, kMinBlockSize});
+  max_block_size_ = std::max({max_block_size, init_block_size_});
+  next_block_size_ = init_block_size_;
+  chunk_limit_ = (max_block_size_ - kBlockHdrSz) / 8 - kChunkHdrSz;
+}
+
+void* GenerationContext::alloc(Size size) {
+  return run_pending_spills(alloc_chunk(size));
+}
+
+void* GenerationContext::alloc_chunk(Size size) {
+  Size chunk_size = MAX_ALIGN(size);
+  Size required_size = kChunkHdrSz + chunk_size;
+
+  // Big requests get a block of their own, which is released as soon as the
+  // chunk is freed. It never becomes the current block.
+  if (chunk_size > chunk_limit_) {
+    GenerationBlock block = new_block(kBlockHdrSz + required_size);
+
+    if (block == nullptr) {
+      return nullptr;
+    }
+
+    return profile_alloc(carve_chunk(block, chunk_size), size);
+  }
+
+  GenerationBlock block = block_;
+
+  if (block == nullptr || block->avail_space() < required_size) {
+    block = next_block(required_size);
+
+    if (block == nullptr) {
+      return nullptr;
+    }
+
+    block_ = block;
+  }
+
+  return profile_alloc(carve_chunk(block, chunk_size), size);
+}
+
+void GenerationContext::free(void* ptr) {
+  if (ptr == nullptr) {
+    return;
+  }
+
+  GenerationChunk chunk = chunk_header(ptr);
+  GenerationBlock block = chunk_block(chunk);
+
+  assert(block != nullptr);
+  assert(block->context == this);
+  profile_free(ptr);
+
+  chunk->block = 0;
+  block->freed_bytes += kChunkHdrSz + chunk->size;
+
+  if (++block->nfree < block->nchunks) {
+    return;
+  }
+
+  // The block is empty now. If it is the current block, simply start over
+  // at its beginning; otherwise it goes away.
+  if (block == block_) {
+    block->free_ptr = reinterpret_cast<Pointer>(block) + kBlockHdrSz;
+    block->nchunks = 0;
+    block->nfree = 0;
+    block->freed_bytes = 0;
+
+    return;
+  }
+
+  unlink_block(block);
+
+  if (free_block_ == nullptr && block->size <= max_block_size_) {
+    block->free_ptr = reinterpret_cast<Pointer>(block) + kBlockHdrSz;
+    block->nchunks = 0;
+    block->nfree = 0;
+    block->freed_bytes = 0;
+    free_block_ = block;
+  } else {
+    release_block(block);
+  }
+}
+
+void* GenerationContext::realloc(void* ptr, Size size) {
+  if (ptr == nullptr) {
+    return alloc(size);
+  }
+
+  GenerationChunk chunk = chunk_header(ptr);
+  Size old_size = chunk->size;
+
+  // Chunk sizes are max-aligned, so the chunk may already be big enough.
+  // (In particular, we always fall out here if the requested size is a
+  // decrease.)
+  if (old_size >= size) {
+    return ptr;
+  }
+
+  // There is no way to grow a chunk in place without bookkeeping we want to
+  // avoid, so allocate a new chunk and copy the data over.
+  void* new_ptr = alloc_chunk(size);
+
+  if (new_ptr == nullptr) {
+    return run_pending_spills(nullptr);
+  }
+
+  std::memcpy(new_ptr, ptr, old_size);
+  free(ptr);
+
+  return run_pending_spills(new_ptr);
+}
+
+void GenerationContext::reset() {
+  check_not_spilling();
+  profile_reset();
+
+  while (blocks_ != nullptr) {
+    GenerationBlock block = blocks_;
+    unlink_block(block);
+    release_block(block);
+  }
+
+  if (free_block_ != nullptr) {
+    release_block(free_block_);
+    free_block_ = nullptr;
+  }
+
+  block_ = nullptr;
+  next_block_size_ = init_block_size_;
+}
+
+void GenerationContext::destroy() { reset(); }
+
+void GenerationContext::check() {
+  const char* name = name_.c_str();
+
+  for (GenerationBlock block = blocks_; block != nullptr;
+       block = block->next) {
+    Pointer start = reinterpret_cast<Pointer>(block) + kBlockHdrSz;
+    int nchunks = 0;
+    int nfree = 0;
+    Size freed_bytes = 0;
+
+    while (start < block->free_ptr) {
+      auto chunk = reinterpret_cast<GenerationChunk>(start);
+
+      if (chunk->block == 0) {
+        nfree++;
+        freed_bytes += kChunkHdrSz + chunk->size;
+      } else if (chunk_block(chunk) != block) {
+        elog(NOTICE, "%s: %s: bogus block link in block %p, chunk %p",
+             __func__, name, block, chunk);
+      }
+
+      nchunks++;
+      start += kChunkHdrSz + chunk->size;
+    }
+
+    if (start != block->free_ptr) {
+      elog(NOTICE, "%s: %s: chunks overrun free pointer in block %p",
+           __func__, name, block);
+    }
+
+    if (nchunks != block->nchunks || nfree != block->nfree) {
+      elog(NOTICE,
+           "%s: %s: block %p counts %d chunks (%d free) but holds %d (%d "
+           "free)",
+           __func__, name, block, block->nchunks, block->nfree, nchunks,
+           nfree);
+    }
+
+    if (freed_bytes != block->freed_bytes) {
+      elog(NOTICE, "%s: %s: block %p counts %lu freed bytes but holds %lu",
+           __func__, name, block, block->freed_bytes, freed_bytes);
+    }
+  }
+}
+
+void GenerationContext::count(MemoryContextCounters* counters) {
+  for (GenerationBlock block = blocks_; block != nullptr;
+       block = block->next) {
+    counters->nblocks++;
+    counters->free_chunks += block->nfree;
+    counters->total_space += block->size;
+    counters->free_space += block->avail_space() + block->freed_bytes;
+  }
+
+  if (free_block_ != nullptr) {
+    counters->nblocks++;
+    counters->total_space += free_block_->size;
+    counters->free_space += free_block_->avail_space();
+  }
+}
+
+GenerationBlock GenerationContext::new_block(Size blk_size) {
+  Memory mem = allocate_block(blk_size);
+
+  if (mem.ptr == nullptr) {
+    elog(ERROR, "%s: %s: out of memory allocating block of %lu bytes",
+         __func__, name_.c_str(), blk_size);
+
+    return nullptr;
+  }
+
+  auto block = static_cast<GenerationBlock>(mem.ptr);
+  block->context = this;
+  block->size = mem.size;
+  block->nchunks = 0;
+  block->nfree = 0;
+  block->freed_bytes = 0;
+  block->free_ptr = static_cast<Pointer>(mem.ptr) + kBlockHdrSz;
+  block->end_ptr = static_cast<Pointer>(mem.ptr) + mem.size;
+  push_block(block);
+
+  return block;
+}
+
+GenerationBlock GenerationContext::next_block(Size required_size) {
+  if (free_block_ != nullptr && free_block_->avail_space() >= required_size) {
+    GenerationBlock block = free_block_;
+    free_block_ = nullptr;
+    push_block(block);
+
+    return block;
+  }
+
+  Size blk_size = next_block_size_;
+
+  if (next_block_size_ < max_block_size_) {
+    next_block_size_ = std::min(next_block_size_ << 1, max_block_size_);
+  }
+
+  return new_block(std::max(blk_size, kBlockHdrSz + required_size));
+}
+
+void GenerationContext::release_block(GenerationBlock block) {
+  deallocate_block(block);
+}
+
+void* GenerationContext::carve_chunk(GenerationBlock block, Size chunk_size) {
+  assert(block->avail_space() >= kChunkHdrSz + chunk_size);
+
+  auto chunk = reinterpret_cast<GenerationChunk>(block->free_ptr);
+  chunk->size = chunk_size;
+  chunk->block = tag_block(block);
+
+  block->free_ptr += kChunkHdrSz + chunk_size;
+  block->nchunks++;
+
+  return reinterpret_cast<Pointer>(chunk) + kChunkHdrSz;
+}
+
+void GenerationContext::push_block(GenerationBlock block) {
+  block->prev = nullptr;
+  block->next = blocks_;
+
+  if (blocks_ != nullptr) {
+    blocks_->prev = block;
+  }
+
+  blocks_ = block;
+}
+
+void GenerationContext::unlink_block(GenerationBlock block) {
+  if (block->prev != nullptr) {
+    block->prev->next = block->next;
+  } else {
+    assert(blocks_ == block);
+    blocks_ = block->next;
+  }
+
+  if (block->next != nullptr) {
+    block->next->prev = block->prev;
+  }
+
+  block->prev = nullptr;
+  block->next = nullptr;
+}
+
+}  // namespace rdbms
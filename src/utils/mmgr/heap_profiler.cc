@@ -0,0 +1,271 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "rdbms/utils/heap_profiler.hpp"
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+
+#include "rdbms/utils/mcxt.hpp"
+
+namespace rdbms {
+
+namespace {
+
+struct HeapSample {
+  MemoryContext context;
+  Size weight;  // Estimated bytes this sample stands for
+  int depth;
+  void* frames[HeapProfiler::kMaxFrames];
+};
+
+// Samples are kept in shards by chunk address, so threads freeing chunks in
+// different contexts rarely contend.
+struct Shard {
+  std::mutex mutex;
+  std::unordered_map<const void*, HeapSample> samples;
+};
+
+constexpr int kNumShards = 16;
+
+Shard shards[kNumShards];
+
+std::atomic<Size> interval{HeapProfiler::kDefaultSampleInterval};
+
+// Bumped by start(), so every thread restarts its countdown at the new
+// interval.
+std::atomic<std::uint64_t> epoch{0};
+
+struct ThreadSampler {
+  std::uint64_t epoch = ~std::uint64_t{0};
+  std::int64_t bytes_until_sample = 0;
+  std::mt19937_64 rng{std::random_device{}()};
+
+  std::int64_t next_countdown(Size mean) {
+    std::exponential_distribution<double> dist(1.0 / mean);
+
+    return static_cast<std::int64_t>(dist(rng)) + 1;
+  }
+};
+
+thread_local ThreadSampler sampler;
+
+Shard& shard_of(const void* ptr) {
+  auto addr = reinterpret_cast<std::uintptr_t>(ptr);
+
+  return shards[(addr >> 4) % kNumShards];
+}
+
+std::string symbolize(void* frame) {
+  char buf[32];
+  Dl_info info;
+
+  if (dladdr(frame, &info) == 0 || info.dli_sname == nullptr) {
+    snprintf(buf, sizeof buf, "%p", frame);
+
+    return buf;
+  }
+
+  int status = 0;
+  std::unique_ptr<char, decltype(&std::free)> demangled(
+      abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status),
+      &std::free);
+  std::string name = status == 0 ? demangled.get() : info.dli_sname;
+
+  snprintf(buf, sizeof buf, "+0x%lx",
+           static_cast<Pointer>(frame) - static_cast<Pointer>(info.dli_saddr));
+
+  return name + buf;
+}
+
+struct CallSite {
+  Size bytes = 0;
+  Size samples = 0;
+};
+
+using Stack = std::vector<void*>;
+using ContextProfile = std::map<Stack, CallSite>;
+
+void render(MemoryContext context,
+            const std::map<MemoryContext, ContextProfile>& profiles, int level,
+            std::string* out) {
+  for (; context != nullptr; context = context->next_sibling()) {
+    std::string indent(2 * level, ' ');
+    char line[128];
+    Size bytes = 0;
+    Size samples = 0;
+    std::vector<std::pair<const Stack*, CallSite>> sites;
+
+    if (auto iter = profiles.find(context); iter != profiles.end()) {
+      for (const auto& [stack, site] : iter->second) {
+        bytes += site.bytes;
+        samples += site.samples;
+        sites.emplace_back(&stack, site);
+      }
+    }
+
+    snprintf(line, sizeof line, ": %lu live bytes in %lu samples\n", bytes,
+             samples);
+    *out += indent + context->name() + line;
+
+    std::sort(sites.begin(), sites.end(), [](const auto& lhs, const auto& rhs) {
+      return lhs.second.bytes > rhs.second.bytes;
+    });
+
+    for (const auto& [stack, site] : sites) {
+      snprintf(line, sizeof line, "  %lu bytes in %lu samples at\n",
+               site.bytes, site.samples);
+      *out += indent + line;
+
+      for (Size i = 0; i < stack->size(); i++) {
+        snprintf(line, sizeof line, "    #%lu ", i);
+        *out += indent + line + symbolize((*stack)[i]) + "\n";
+      }
+    }
+
+    render(context->first_child(), profiles, level + 1, out);
+  }
+}
+
+}  // namespace
+
+void HeapProfiler::start(Size sample_interval) {
+  interval.store(std::max<Size>(sample_interval, 1));
+  epoch.fetch_add(1);
+  enabled_.store(true);
+}
+
+void HeapProfiler::stop() {
+  enabled_.store(false);
+
+  for (Shard& shard : shards) {
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    shard.samples.clear();
+  }
+
+  generation_.fetch_add(1);
+}
+
+Size HeapProfiler::sample_interval() { return interval.load(); }
+
+Size HeapProfiler::live_bytes(MemoryContext context) {
+  Size bytes = 0;
+
+  for (Shard& shard : shards) {
+    std::lock_guard<std::mutex> guard(shard.mutex);
+
+    for (const auto& [ptr, sample] : shard.samples) {
+      if (sample.context == context) {
+        bytes += sample.weight;
+      }
+    }
+  }
+
+  return bytes;
+}
+
+Size HeapProfiler::live_samples(MemoryContext context) {
+  Size samples = 0;
+
+  for (Shard& shard : shards) {
+    std::lock_guard<std::mutex> guard(shard.mutex);
+
+    for (const auto& [ptr, sample] : shard.samples) {
+      samples += sample.context == context;
+    }
+  }
+
+  return samples;
+}
+
+std::string HeapProfiler::report(MemoryContext root) {
+  std::map<MemoryContext, ContextProfile> profiles;
+
+  for (Shard& shard : shards) {
+    std::lock_guard<std::mutex> guard(shard.mutex);
+
+    for (const auto& [ptr, sample] : shard.samples) {
+      Stack stack(sample.frames, sample.frames + sample.depth);
+      CallSite& site = profiles[sample.context][stack];
+      site.bytes += sample.weight;
+      site.samples++;
+    }
+  }
+
+  std::string out;
+  render(root, profiles, 0, &out);
+
+  return out;
+}
+
+void HeapProfiler::dump(MemoryContext root) {
+  fputs(report(root).c_str(), stderr);
+}
+
+bool HeapProfiler::sample_alloc(MemoryContext context, const void* ptr,
+                                Size size) {
+  if (ptr == nullptr) {
+    return false;
+  }
+
+  Size mean = interval.load(std::memory_order_relaxed);
+
+  if (std::uint64_t current = epoch.load(std::memory_order_relaxed);
+      sampler.epoch != current) {
+    sampler.epoch = current;
+    sampler.bytes_until_sample = sampler.next_countdown(mean);
+  }
+
+  sampler.bytes_until_sample -= static_cast<std::int64_t>(size);
+
+  if (sampler.bytes_until_sample > 0) {
+    return false;
+  }
+
+  sampler.bytes_until_sample = sampler.next_countdown(mean);
+
+  HeapSample sample;
+  sample.context = context;
+
+  double probability = -std::expm1(-static_cast<double>(size) / mean);
+  sample.weight = static_cast<Size>(std::llround(size / probability));
+
+  // Skip this function's own frame.
+  void* frames[kMaxFrames + 1];
+  int depth = backtrace(frames, kMaxFrames + 1);
+  sample.depth = std::max(depth - 1, 0);
+  std::copy(frames + 1, frames + 1 + sample.depth, sample.frames);
+
+  Shard& shard = shard_of(ptr);
+  std::lock_guard<std::mutex> guard(shard.mutex);
+  shard.samples[ptr] = sample;
+
+  return true;
+}
+
+bool HeapProfiler::sample_free(const void* ptr) {
+  Shard& shard = shard_of(ptr);
+  std::lock_guard<std::mutex> guard(shard.mutex);
+
+  return shard.samples.erase(ptr) != 0;
+}
+
+void HeapProfiler::forget_context(MemoryContext context) {
+  for (Shard& shard : shards) {
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    std::erase_if(shard.samples, [context](const auto& entry) {
+      return entry.second.context == context;
+    });
+  }
+}
+
+}  // namespace rdbms
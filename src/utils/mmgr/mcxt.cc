@@ -1,14 +1,22 @@
+#include <algorithm>
+#include <cstdio>
+
 #include "rdbms/utils/mcxt.hpp"
 
+#include "rdbms/utils/elog.hpp"
+#include "rdbms/utils/palloc.hpp"
+
 namespace rdbms {
 
+thread_local MemoryContext current_memory_context = nullptr;
+
 MemoryContextData::MemoryContextData(NodeTag type, MemoryContext parent,
                                      std::string name)
     : type_(type),
       parent_(parent),
-      name_(std::move(name)),
       first_child_{nullptr},
-      next_sibling_{nullptr} {
+      next_sibling_{nullptr},
+      name_(std::move(name)) {
   if (parent_) {
     next_sibling_ = parent_->first_child_;
     parent_->first_child_ = this;
@@ -45,4 +53,218 @@ void MemoryContextData::destroy_subtree(MemoryContext context) {
   context->destroy();
 }
 
+MemoryContextCounters MemoryContextData::counters() {
+  MemoryContextCounters counters;
+  count(&counters);
+  counters.peak_allocated = peak_allocated_;
+
+  return counters;
+}
+
+MemoryContextCounters MemoryContextData::tree_counters() {
+  MemoryContextCounters totals = counters();
+
+  for (MemoryContext child = first_child_; child != nullptr;
+       child = child->next_sibling_) {
+    totals += child->tree_counters();
+  }
+
+  return totals;
+}
+
+void MemoryContextData::stats() {
+  MemoryContextCounters counters = this->counters();
+
+  fprintf(stderr,
+          "%s: %ld total in %ld blocks; %ld free (%ld chunks); %ld used\n",
+          name_.c_str(), counters.total_space, counters.nblocks,
+          counters.free_space, counters.free_chunks, counters.used_space());
+}
+
+std::string MemoryContextData::stats_json() {
+  std::string out;
+  append_json(&out);
+
+  return out;
+}
+
+void MemoryContextData::append_json(std::string* out) {
+  *out += "{\"name\":\"";
+
+  for (char c : name_) {
+    if (c == '"' || c == '\\') {
+      *out += '\\';
+      *out += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char escaped[8];
+      snprintf(escaped, sizeof escaped, "\\u%04x", c);
+      *out += escaped;
+    } else {
+      *out += c;
+    }
+  }
+
+  MemoryContextCounters counters = this->counters();
+  char buf[256];
+  snprintf(buf, sizeof buf,
+           "\",\"nblocks\":%lu,\"free_chunks\":%lu,\"total_space\":%lu,"
+           "\"free_space\":%lu,\"used_space\":%lu,\"peak_allocated\":%lu,"
+           "\"children\":[",
+           counters.nblocks, counters.free_chunks, counters.total_space,
+           counters.free_space, counters.used_space(),
+           counters.peak_allocated);
+  *out += buf;
+
+  for (MemoryContext child = first_child_; child != nullptr;
+       child = child->next_sibling_) {
+    child->append_json(out);
+
+    if (child->next_sibling_ != nullptr) {
+      *out += ',';
+    }
+  }
+
+  *out += "]}";
+}
+
+Memory MemoryContextData::allocate_block(Size size) {
+  check_soft_limits(size);
+
+  Size headroom = this->headroom();
+
+  if (size > headroom) {
+    elog(ERROR, "%s: %s: memory limit exceeded allocating block of %lu bytes",
+         __func__, name_.c_str(), size);
+
+    return {nullptr, 0};
+  }
+
+  // A block from MemoryPool's cache may be bigger than asked for, so pass
+  // the headroom on.
+  Memory mem = huge_pages_ ? MemoryPool::allocate_huge(size, headroom)
+                           : MemoryPool::allocate(size, headroom);
+
+  if (mem.ptr != nullptr) {
+    account(mem.size, 0, 1);
+  }
+
+  return mem;
+}
+
+Memory MemoryContextData::reallocate_block(void* block, Size size) {
+  if (block == nullptr) {
+    return allocate_block(size);
+  }
+
+  Size old_size = MemoryPool::capacity(block);
+
+  if (size > old_size) {
+    check_soft_limits(size - old_size);
+  }
+
+  if (size > old_size && size - old_size > headroom()) {
+    elog(ERROR, "%s: %s: memory limit exceeded resizing block to %lu bytes",
+         __func__, name_.c_str(), size);
+
+    return {nullptr, 0};
+  }
+
+  Memory mem = MemoryPool::reallocate(block, size);
+
+  if (mem.ptr != nullptr) {
+    account(mem.size, old_size, 0);
+  }
+
+  return mem;
+}
+
+void MemoryContextData::deallocate_block(void* block) {
+  if (block == nullptr) {
+    return;
+  }
+
+  account(0, MemoryPool::capacity(block), -1);
+  MemoryPool::deallocate(block);
+}
+
+Size MemoryContextData::headroom() const {
+  Size headroom = ~Size{0};
+
+  for (auto context = this; context != nullptr; context = context->parent_) {
+    if (context->mem_limit_ != 0) {
+      Size used = std::min(context->total_allocated_, context->mem_limit_);
+      headroom = std::min(headroom, context->mem_limit_ - used);
+    }
+  }
+
+  return headroom;
+}
+
+void MemoryContextData::check_soft_limits(Size size) {
+  for (MemoryContext context = this; context != nullptr;
+       context = context->parent_) {
+    if (context->soft_mem_limit_ == 0 || context->over_soft_limit_ ||
+        context->spilling_ ||
+        context->total_allocated_ + size <= context->soft_mem_limit_) {
+      continue;
+    }
+
+    context->over_soft_limit_ = true;
+    context->spill_due_ = true;
+    spill_pending_ = true;
+  }
+}
+
+void MemoryContextData::fire_spill_callbacks() {
+  // A callback allocating here may run callbacks of its own; the outer
+  // ones still need this context left alone once those are done.
+  bool was_spill_source = spill_source_;
+  spill_pending_ = false;
+  spill_source_ = true;
+
+  for (MemoryContext context = this; context != nullptr;
+       context = context->parent_) {
+    if (!context->spill_due_) {
+      continue;
+    }
+
+    elog(DEBUG, "%s: %s: soft memory limit of %lu bytes reached, spilling",
+         __func__, context->name_.c_str(), context->soft_mem_limit_);
+
+    context->spill_due_ = false;
+    context->spilling_ = true;
+    context->nspills_++;
+
+    for (const SpillCallback& callback : context->spill_callbacks_) {
+      callback(context);
+    }
+
+    context->spilling_ = false;
+
+    // If the callbacks released enough, the next crossing fires them again.
+    context->over_soft_limit_ =
+        context->total_allocated_ > context->soft_mem_limit_;
+  }
+
+  spill_source_ = was_spill_source;
+}
+
+void MemoryContextData::account(Size added, Size removed, int nblocks) {
+  mem_allocated_ += added - removed;
+  nblocks_ += nblocks;
+
+  // Contexts are rarely nested more than a few levels deep, and blocks are
+  // allocated far less often than chunks, so walking up is cheap enough.
+  for (MemoryContext context = this; context != nullptr;
+       context = context->parent_) {
+    context->total_allocated_ += added - removed;
+    context->peak_allocated_ =
+        std::max(context->peak_allocated_, context->total_allocated_);
+
+    if (context->total_allocated_ <= context->soft_mem_limit_) {
+      context->over_soft_limit_ = false;
+    }
+  }
+}
+
 }  // namespace rdbms
@@ -0,0 +1,275 @@
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstdio>
+
+#include "rdbms/utils/slab.hpp"
+
+#include "rdbms/utils/elog.hpp"
+
+namespace rdbms {
+
+SlabContext::SlabContext(MemoryContext parent, std::string name,
+                         Size block_size, Size chunk_size)
+    : MemoryContextData(kSlabContext, parent, std::move(name)),
+      chunk_size_(chunk_size),
+      nblocks_(0),
+      free_blocks_(nullptr),
+      full_blocks_(nullptr) {
+  assert(chunk_size > 0);
+
+  full_chunk_size_ = MAX_ALIGN(kChunkHdrSz + chunk_size);
+
+  // The block must be able to hold at least one chunk.
+  block_size_ = std::max(block_size, data_offset(1) + chunk_size);
+
+  // The bitmap shrinks as the number of chunks goes down, so start from an
+  // upper bound and back off until the layout fits into the block.
+  int nchunks = (block_size_ - sizeof(SlabBlockData)) / full_chunk_size_;
+
+  while (nchunks > 1 && data_offset(nchunks) +
+                                (nchunks - 1) * full_chunk_size_ +
+                                chunk_size >
+                            block_size_) {
+    nchunks--;
+  }
+
+  chunks_per_block_ = std::max(nchunks, 1);
+  bitmap_words_ = (chunks_per_block_ + kBitsPerWord - 1) / kBitsPerWord;
+  data_offset_ = data_offset(chunks_per_block_);
+}
+
+void* SlabContext::alloc(Size size) {
+  if (size > chunk_size_) {
+    elog(ERROR, "%s: %s: unexpected alloc chunk size %lu (expected %lu)",
+         __func__, name_.c_str(), size, chunk_size_);
+
+    return nullptr;
+  }
+
+  SlabBlock block = free_blocks_;
+
+  if (block == nullptr) {
+    block = new_block();
+
+    if (block == nullptr) {
+      return run_pending_spills(nullptr);
+    }
+  }
+
+  assert(block->nfree > 0);
+
+  // Find the lowest free chunk. Every word before `first_word` is known to
+  // be zero, so this normally inspects a single word.
+  int word = block->first_word;
+
+  while (block->free_bits[word] == 0) {
+    word++;
+  }
+
+  assert(word < bitmap_words_);
+
+  int bit = std::countr_zero(block->free_bits[word]);
+  block->free_bits[word] &= ~(u64{1} << bit);
+  block->first_word = word;
+
+  // A block without free chunks leaves the free list until one of its chunks
+  // comes back.
+  if (--block->nfree == 0) {
+    unlink_block(&free_blocks_, block);
+    push_block(&full_blocks_, block);
+  }
+
+  Pointer data = chunk_data(block, word * kBitsPerWord + bit);
+  chunk_header(data)->block = tag_block(block);
+
+  return run_pending_spills(profile_alloc(data, size));
+}
+
+void SlabContext::free(void* ptr) {
+  if (ptr == nullptr) {
+    return;
+  }
+
+  SlabBlock block = chunk_block(ptr);
+  assert(block->slab == this);
+  profile_free(ptr);
+
+  int index = chunk_index(block, ptr);
+  int word = index / kBitsPerWord;
+  u64 mask = u64{1} << (index % kBitsPerWord);
+
+  assert(index < chunks_per_block_);
+  assert((block->free_bits[word] & mask) == 0);
+
+  block->free_bits[word] |= mask;
+  block->first_word = std::min(block->first_word, word);
+
+  if (block->nfree++ == 0) {
+    unlink_block(&full_blocks_, block);
+    push_block(&free_blocks_, block);
+  }
+
+  // Return an empty block to the pool, unless no other block could serve the
+  // next request.
+  if (block->nfree == chunks_per_block_ &&
+      (block->prev != nullptr || block->next != nullptr)) {
+    unlink_block(&free_blocks_, block);
+    release_block(block);
+  }
+}
+
+void* SlabContext::realloc(void* ptr, Size size) {
+  if (ptr == nullptr) {
+    return alloc(size);
+  }
+
+  if (size > chunk_size_) {
+    elog(ERROR, "%s: %s: cannot grow a slab chunk to %lu bytes", __func__,
+         name_.c_str(), size);
+
+    return nullptr;
+  }
+
+  return ptr;
+}
+
+void SlabContext::reset() {
+  check_not_spilling();
+  profile_reset();
+
+  for (SlabBlock head : {free_blocks_, full_blocks_}) {
+    while (head != nullptr) {
+      SlabBlock next = head->next;
+      release_block(head);
+      head = next;
+    }
+  }
+
+  free_blocks_ = nullptr;
+  full_blocks_ = nullptr;
+  assert(nblocks_ == 0);
+}
+
+void SlabContext::destroy() { reset(); }
+
+void SlabContext::check() {
+  const char* name = name_.c_str();
+
+  for (SlabBlock head : {free_blocks_, full_blocks_}) {
+    for (SlabBlock block = head; block != nullptr; block = block->next) {
+      int nfree = 0;
+
+      for (int word = 0; word < bitmap_words_; word++) {
+        nfree += std::popcount(block->free_bits[word]);
+
+        if (word < block->first_word && block->free_bits[word] != 0) {
+          elog(NOTICE, "%s: %s: free chunk below first_word in block %p",
+               __func__, name, block);
+        }
+      }
+
+      if (nfree != block->nfree) {
+        elog(NOTICE, "%s: %s: bitmap has %d free chunks, block %p claims %d",
+             __func__, name, nfree, block, block->nfree);
+      }
+
+      if ((head == full_blocks_) != (block->nfree == 0)) {
+        elog(NOTICE, "%s: %s: block %p with %d free chunks on wrong list",
+             __func__, name, block, block->nfree);
+      }
+
+      for (int i = 0; i < chunks_per_block_; i++) {
+        bool is_free = (block->free_bits[i / kBitsPerWord] >>
+                        (i % kBitsPerWord)) &
+                       1;
+
+        if (!is_free && chunk_block(chunk_data(block, i)) != block) {
+          elog(NOTICE, "%s: %s: bogus block link in block %p, chunk %d",
+               __func__, name, block, i);
+        }
+      }
+    }
+  }
+}
+
+void SlabContext::count(MemoryContextCounters* counters) {
+  Size nchunks = 0;
+
+  for (SlabBlock block = free_blocks_; block != nullptr; block = block->next) {
+    nchunks += block->nfree;
+  }
+
+  // A block from MemoryPool's cache can be bigger than block_size_. Chunks
+  // are never carved from the excess, so it counts as free space.
+  counters->nblocks += nblocks_;
+  counters->free_chunks += nchunks;
+  counters->total_space += mem_allocated();
+  counters->free_space +=
+      nchunks * full_chunk_size_ + (mem_allocated() - nblocks_ * block_size_);
+}
+
+SlabBlock SlabContext::new_block() {
+  Memory mem = allocate_block(block_size_);
+
+  if (mem.ptr == nullptr) {
+    elog(ERROR, "%s: %s: out of memory allocating block of %lu bytes",
+         __func__, name_.c_str(), block_size_);
+
+    return nullptr;
+  }
+
+  auto block = static_cast<SlabBlock>(mem.ptr);
+  block->slab = this;
+  block->prev = nullptr;
+  block->next = nullptr;
+  block->nfree = chunks_per_block_;
+  block->first_word = 0;
+
+  // Mark every chunk free. Bits past the last chunk stay clear, so they can
+  // never be handed out.
+  for (int word = 0; word < bitmap_words_; word++) {
+    int nbits = std::min(chunks_per_block_ - word * kBitsPerWord, kBitsPerWord);
+    block->free_bits[word] =
+        nbits == kBitsPerWord ? ~u64{0} : (u64{1} << nbits) - 1;
+  }
+
+  push_block(&free_blocks_, block);
+  nblocks_++;
+
+  return block;
+}
+
+void SlabContext::release_block(SlabBlock block) {
+  deallocate_block(block);
+  nblocks_--;
+}
+
+void SlabContext::push_block(SlabBlock* head, SlabBlock block) {
+  block->prev = nullptr;
+  block->next = *head;
+
+  if (*head != nullptr) {
+    (*head)->prev = block;
+  }
+
+  *head = block;
+}
+
+void SlabContext::unlink_block(SlabBlock* head, SlabBlock block) {
+  if (block->prev != nullptr) {
+    block->prev->next = block->next;
+  } else {
+    assert(*head == block);
+    *head = block->next;
+  }
+
+  if (block->next != nullptr) {
+    block->next->prev = block->prev;
+  }
+
+  block->prev = nullptr;
+  block->next = nullptr;
+}
+
+}  // namespace rdbms
@@ -0,0 +1,109 @@
+#include <cstring>
+#include <vector>
+
+#include "rdbms/storage/dsm.hpp"
+
+#include <gtest/gtest.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "rdbms/storage/dsa.hpp"
+
+using namespace rdbms;
+
+TEST(DsmSegment, CreateAndAttach) {
+  DsmHandle handle;
+
+  {
+    DsmSegment creator(64 * 1024);
+    ASSERT_TRUE(creator.is_ok());
+    handle = creator.handle();
+    std::strcpy(static_cast<char*>(creator.address()), "dsm");
+
+    // A second mapping sees the same memory at another address.
+    DsmSegment attached(handle);
+    ASSERT_TRUE(attached.is_ok());
+    EXPECT_NE(creator.address(), attached.address());
+    EXPECT_EQ(64 * 1024, attached.size());
+    EXPECT_STREQ("dsm", static_cast<char*>(attached.address()));
+  }
+
+  // The creator removed the segment on its way out.
+  DsmSegment gone(handle);
+  EXPECT_FALSE(gone.is_ok());
+}
+
+TEST(DsaArea, AllocAndReuse) {
+  DsaArea area(64 * 1024);
+  ASSERT_TRUE(area.is_ok());
+
+  DsaPointer small = area.alloc(100);
+  ASSERT_NE(kInvalidDsaPointer, small);
+  EXPECT_EQ(0, reinterpret_cast<std::uintptr_t>(area.get_address(small)) %
+                   MAXIMUM_ALIGNOF);
+  std::memset(area.get_address(small), 0xAB, 100);
+
+  // Freed chunks are handed out again, small and big alike.
+  area.free(small);
+  EXPECT_EQ(small, area.alloc(90));
+
+  DsaPointer big = area.alloc(200 * 1024);
+  ASSERT_NE(kInvalidDsaPointer, big);
+  area.free(big);
+  EXPECT_EQ(big, area.alloc(150 * 1024));
+}
+
+TEST(DsaArea, GrowsBySegments) {
+  DsaArea area(64 * 1024);
+  std::vector<DsaPointer> chunks;
+
+  for (int i = 0; i < 1000; i++) {
+    DsaPointer dp = area.alloc(1000);
+    ASSERT_NE(kInvalidDsaPointer, dp);
+    std::memset(area.get_address(dp), i & 0xFF, 1000);
+    chunks.push_back(dp);
+  }
+
+  EXPECT_GT(area.nsegments(), 1);
+  EXPECT_GE(area.total_size(), 1000 * 1000);
+
+  for (int i = 0; i < 1000; i++) {
+    auto data = static_cast<unsigned char*>(area.get_address(chunks[i]));
+    EXPECT_EQ(i & 0xFF, data[999]);
+  }
+}
+
+// A worker attaches to the area, grows it and hands a relative pointer back.
+TEST(DsaArea, SharedWithChildProcess) {
+  DsaArea area(64 * 1024);
+  DsaPointer slot = area.alloc(sizeof(DsaPointer));
+  *static_cast<DsaPointer*>(area.get_address(slot)) = kInvalidDsaPointer;
+
+  pid_t pid = fork();
+  ASSERT_NE(-1, pid);
+
+  if (pid == 0) {
+    DsaArea worker(area.handle());
+    DsaPointer dp = worker.alloc(256 * 1024);
+
+    if (dp != kInvalidDsaPointer) {
+      std::strcpy(static_cast<char*>(worker.get_address(dp)), "from worker");
+      *static_cast<DsaPointer*>(worker.get_address(slot)) = dp;
+    }
+
+    _exit(0);
+  }
+
+  waitpid(pid, nullptr, 0);
+
+  DsaPointer dp = *static_cast<DsaPointer*>(area.get_address(slot));
+  ASSERT_NE(kInvalidDsaPointer, dp);
+  EXPECT_EQ(2, area.nsegments());
+  EXPECT_STREQ("from worker", static_cast<char*>(area.get_address(dp)));
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
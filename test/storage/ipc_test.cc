@@ -122,6 +122,25 @@ TEST(Semaphore, DiscoverAndRemoveLegacy) {
   }
 }
 
+TEST(Semaphore, KeysStartFromDataDirectory) {
+  key_t key = ipc_key_from_path("/tmp");
+  EXPECT_GT(key, 0);
+  EXPECT_EQ(key, ipc_key_from_path("/tmp"));
+  EXPECT_EQ(-1, ipc_key_from_path("/no/such/directory"));
+
+  // A failed lookup must not send probing to IPC_PRIVATE.
+  EXPECT_FALSE(Semaphore::set_key_base(-1));
+  EXPECT_FALSE(Semaphore::set_key_base(0));
+  EXPECT_FALSE(SharedMemory::set_key_base(-1));
+
+  ASSERT_TRUE(Semaphore::set_key_base(key));
+  Semaphore sema(2, 0600, 1);
+  EXPECT_TRUE(sema.is_ok());
+  EXPECT_GE(Semaphore::key(), key);
+  EXPECT_TRUE(sema.try_acquire(1));
+  EXPECT_FALSE(sema.try_acquire(1));
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
 
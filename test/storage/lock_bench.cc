@@ -0,0 +1,381 @@
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <random>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "rdbms/storage/slock.hpp"
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "rdbms/storage/ipc.hpp"
+#include "rdbms/storage/lwlock.hpp"
+#include "rdbms/storage/sema.hpp"
+
+using namespace rdbms;
+
+// Sweeps every lock type over worker counts, critical section lengths and
+// read ratios, and prints one CSV line per run with the throughput and the
+// acquire latency percentiles:
+//
+//   lock_bench [--max-workers=N] [--duration-ms=M]
+//
+// Workers are threads, except for the semaphores, whose workers are forked
+// processes sharing the semaphore as a mutex. A critical section of length
+// L reads the protected counters L times, or increments them L times for a
+// write; only LWLock lets readers in together, the other locks serialize
+// reads as well. AtomicLock sleeps a full second on contention, which its
+// latencies will show.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Log-linear latency histogram in nanoseconds: 16 buckets for every power
+// of 2, so percentiles are accurate to about 6%.
+class LatencyHistogram {
+ public:
+  static constexpr int kSubBits = 4;
+  static constexpr int kNumBuckets = 64 << kSubBits;
+
+  void record(u64 nanos) {
+    counts_[bucket(nanos)]++;
+    total_++;
+  }
+
+  void merge(const LatencyHistogram& other) {
+    for (int i = 0; i < kNumBuckets; i++) {
+      counts_[i] += other.counts_[i];
+    }
+
+    total_ += other.total_;
+  }
+
+  u64 total() const { return total_; }
+
+  // Upper bound of the bucket holding the `q` quantile.
+  u64 percentile(double q) const {
+    u64 rank = static_cast<u64>(q * total_);
+    u64 seen = 0;
+
+    for (int i = 0; i < kNumBuckets; i++) {
+      seen += counts_[i];
+
+      if (seen > rank) {
+        return upper_bound(i);
+      }
+    }
+
+    return 0;
+  }
+
+ private:
+  static int bucket(u64 nanos) {
+    if (nanos < (1u << kSubBits)) {
+      return nanos;
+    }
+
+    int shift = std::bit_width(nanos) - 1 - kSubBits;
+
+    return ((shift + 1) << kSubBits) +
+           ((nanos >> shift) & ((1 << kSubBits) - 1));
+  }
+
+  static u64 upper_bound(int index) {
+    if (index < (1 << kSubBits)) {
+      return index;
+    }
+
+    int shift = (index >> kSubBits) - 1;
+    u64 sub = index & ((1 << kSubBits) - 1);
+
+    return (((1 << kSubBits) + sub + 1) << shift) - 1;
+  }
+
+  u64 counts_[kNumBuckets] = {};
+  u64 total_ = 0;
+};
+
+// The data a lock protects; readers check that writers left it consistent.
+struct Protected {
+  alignas(CACHE_LINE_SIZE) volatile u64 a;
+  volatile u64 b;
+};
+
+struct RunConfig {
+  int nworkers;
+  int cs_length;
+  int read_pct;
+  int duration_ms;
+};
+
+struct WorkerResult {
+  LatencyHistogram latencies;
+  u64 torn_reads;
+};
+
+void critical_section(Protected* data, int cs_length, bool write,
+                      u64* torn_reads) {
+  for (int i = 0; i < cs_length || i == 0; i++) {
+    if (write) {
+      data->a = data->a + 1;
+      data->b = data->b + 1;
+    } else if (data->a != data->b) {
+      (*torn_reads)++;
+    }
+  }
+}
+
+// The loop of one worker: `acquire(write)` and `release()` take and drop
+// the lock under test.
+template <typename Acquire, typename Release>
+void worker_loop(const RunConfig& config, const std::atomic<bool>& stop,
+                 Protected* data, int seed, Acquire acquire, Release release,
+                 WorkerResult* result) {
+  std::minstd_rand gen(seed);
+  std::uniform_int_distribution<int> pct(0, 99);
+
+  while (!stop.load(std::memory_order_relaxed)) {
+    bool write = pct(gen) >= config.read_pct;
+    auto start = Clock::now();
+    acquire(write);
+    auto acquired = Clock::now();
+
+    critical_section(data, config.cs_length, write, &result->torn_reads);
+    release();
+
+    result->latencies.record(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(acquired - start)
+            .count());
+  }
+}
+
+// `elapsed` runs from starting the workers to the last one stopping, so a
+// worker that overruns the duration, such as AtomicLock asleep, counts.
+void report(const char* lock, const char* workers, const RunConfig& config,
+            Clock::duration elapsed, const std::vector<WorkerResult>& results) {
+  LatencyHistogram latencies;
+  u64 torn_reads = 0;
+
+  for (const auto& result : results) {
+    latencies.merge(result.latencies);
+    torn_reads += result.torn_reads;
+  }
+
+  double ops_per_sec =
+      latencies.total() / std::chrono::duration<double>(elapsed).count();
+
+  printf("%s,%s,%d,%d,%d,%llu,%.0f,%llu,%llu,%llu\n", lock, workers,
+         config.nworkers, config.cs_length, config.read_pct,
+         static_cast<unsigned long long>(latencies.total()), ops_per_sec,
+         static_cast<unsigned long long>(latencies.percentile(0.5)),
+         static_cast<unsigned long long>(latencies.percentile(0.99)),
+         static_cast<unsigned long long>(latencies.percentile(0.999)));
+  fflush(stdout);
+
+  if (torn_reads > 0) {
+    fprintf(stderr, "%s: %llu torn reads, the lock is broken\n", lock,
+            static_cast<unsigned long long>(torn_reads));
+    exit(1);
+  }
+}
+
+// Locks from slock.hpp, with readers taking the lock exclusively.
+template <typename Lock>
+void run_threads(const RunConfig& config) {
+  Lock lock;
+  Protected data{};
+  std::atomic<bool> stop{false};
+  std::vector<WorkerResult> results(config.nworkers);
+  std::vector<std::thread> workers;
+  auto start = Clock::now();
+
+  for (int i = 0; i < config.nworkers; i++) {
+    workers.emplace_back([&, i] {
+      worker_loop(
+          config, stop, &data, i, [&](bool) { lock.acquire(); },
+          [&] { lock.release(); }, &results[i]);
+    });
+  }
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(config.duration_ms));
+  stop = true;
+
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  report(Lock::name(), "threads", config, Clock::now() - start, results);
+}
+
+void run_lwlock(const RunConfig& config) {
+  LWLock lock;
+  Protected data{};
+  std::atomic<bool> stop{false};
+  std::vector<WorkerResult> results(config.nworkers);
+  std::vector<LWLockWaiter> waiters(config.nworkers);
+  std::vector<std::thread> workers;
+  auto start = Clock::now();
+
+  for (int i = 0; i < config.nworkers; i++) {
+    workers.emplace_back([&, i] {
+      LWLock::set_my_waiter(&waiters[i]);
+      worker_loop(
+          config, stop, &data, i,
+          [&](bool write) {
+            lock.acquire(write ? LWLockMode::kExclusive : LWLockMode::kShared);
+          },
+          [&] { lock.release(); }, &results[i]);
+    });
+  }
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(config.duration_ms));
+  stop = true;
+
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  report("LWLock", "threads", config, Clock::now() - start, results);
+}
+
+// Semaphores used as a mutex by forked workers. Results come back through
+// a shared mapping, which also holds the protected data and the stop flag.
+template <typename Acquire, typename Release>
+void run_processes(const char* name, const RunConfig& config, void* shared,
+                   Acquire acquire, Release release) {
+  auto stop = ::new (shared) std::atomic<bool>(false);
+  auto data = ::new (static_cast<char*>(shared) + CACHE_LINE_SIZE) Protected{};
+  auto results = reinterpret_cast<WorkerResult*>(static_cast<char*>(shared) +
+                                                 2 * CACHE_LINE_SIZE);
+  std::fill_n(results, config.nworkers, WorkerResult{});
+  std::vector<pid_t> pids;
+  auto start = Clock::now();
+
+  for (int i = 0; i < config.nworkers; i++) {
+    pid_t pid = fork();
+
+    if (pid == 0) {
+      worker_loop(config, *stop, data, i, acquire, release, &results[i]);
+
+      // Skip the destructors: they would remove the semaphores.
+      _exit(0);
+    }
+
+    pids.push_back(pid);
+  }
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(config.duration_ms));
+  stop->store(true);
+
+  for (pid_t pid : pids) {
+    waitpid(pid, nullptr, 0);
+  }
+
+  report(name, "processes", config, Clock::now() - start,
+         std::vector<WorkerResult>(results, results + config.nworkers));
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int max_workers = std::max(1u, std::thread::hardware_concurrency());
+  int duration_ms = 200;
+
+  bool usage = false;
+
+  for (int i = 1; i < argc; i++) {
+    std::string_view arg(argv[i]);
+
+    if (arg.starts_with("--max-workers=")) {
+      max_workers = atoi(argv[i] + strlen("--max-workers="));
+    } else if (arg.starts_with("--duration-ms=")) {
+      duration_ms = atoi(argv[i] + strlen("--duration-ms="));
+    } else {
+      usage = true;
+    }
+  }
+
+  // Both take a positive count; atoi() turns garbage into 0.
+  if (usage || max_workers < 1 || duration_ms < 1) {
+    fprintf(stderr, "usage: %s [--max-workers=N] [--duration-ms=M]\n",
+            argv[0]);
+
+    return 1;
+  }
+
+  Size shared_size = 2 * CACHE_LINE_SIZE + sizeof(WorkerResult) * max_workers;
+  void* shared = ::mmap(nullptr, shared_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+  if (shared == MAP_FAILED) {
+    perror("mmap");
+
+    return 1;
+  }
+
+  void* futex_mem = ::mmap(nullptr, sizeof(FutexSemaphore),
+                           PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                           -1, 0);
+
+  if (futex_mem == MAP_FAILED) {
+    perror("mmap");
+
+    return 1;
+  }
+
+  Semaphore sema(1, 0600, 1);
+  BinarySemaphore binary_sema;
+  auto futex_sema = ::new (futex_mem) FutexSemaphore(1);
+
+  binary_sema.release();
+
+  printf(
+      "lock,workers,nworkers,cs_length,read_pct,ops,ops_per_sec,p50_ns,"
+      "p99_ns,p999_ns\n");
+
+  std::vector<int> worker_counts;
+
+  for (int n = 1; n < max_workers; n *= 2) {
+    worker_counts.push_back(n);
+  }
+
+  worker_counts.push_back(max_workers);
+
+  for (int nworkers : worker_counts) {
+    for (int cs_length : {1, 10, 100}) {
+      for (int read_pct : {0, 50, 90, 99}) {
+        RunConfig config{nworkers, cs_length, read_pct, duration_ms};
+
+        run_threads<TasLock>(config);
+        run_threads<MutexLock>(config);
+        run_threads<AtomicLock>(config);
+        run_threads<McsLock>(config);
+        run_lwlock(config);
+
+        run_processes(
+            "Semaphore", config, shared, [&](bool) { sema.acquire(0, false); },
+            [&] { sema.release(0); });
+        run_processes(
+            "BinarySemaphore", config, shared,
+            [&](bool) { binary_sema.acquire(); },
+            [&] { binary_sema.release(); });
+        run_processes(
+            "FutexSemaphore", config, shared,
+            [&](bool) { futex_sema->acquire(false); },
+            [&] { futex_sema->release(); });
+      }
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,132 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "rdbms/storage/lock_stats.hpp"
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+using namespace rdbms;
+using namespace std::chrono_literals;
+
+// Wait until backend `backend_id` waits on something, and return what.
+static WaitEvent await_wait_event(const LockStats& stats, int backend_id) {
+  while (true) {
+    WaitEvent event = stats.wait_event(backend_id);
+
+    if (event.type != WaitEventType::kNone) {
+      return event;
+    }
+
+    std::this_thread::sleep_for(100us);
+  }
+}
+
+TEST(LockStats, CountsSpinLockContention) {
+  ShmemAllocator shmem(1024 * 1024, 0600, true);
+  LockStats stats(&shmem, 4);
+  SpinManager spins(&shmem);
+  ASSERT_TRUE(stats.is_ok());
+  ASSERT_TRUE(spins.is_ok());
+
+  stats.attach(0);
+  EXPECT_EQ(getpid(), stats.pid(0));
+  EXPECT_EQ(0, stats.pid(1));
+
+  spins.acquire(kBufMgrLockId);
+
+  std::thread waiter([&] {
+    stats.attach(1);
+    spins.acquire(kBufMgrLockId);
+    spins.release(kBufMgrLockId);
+    LockStats::detach();
+  });
+
+  WaitEvent event = await_wait_event(stats, 1);
+  EXPECT_EQ(WaitEventType::kSpinLock, event.type);
+  EXPECT_EQ(kBufMgrLockId, event.lock_id);
+  EXPECT_NE(nullptr, event.lock);
+  EXPECT_EQ(WaitEventType::kNone, stats.wait_event(0).type);
+
+  std::this_thread::sleep_for(20ms);
+  spins.release(kBufMgrLockId);
+  waiter.join();
+
+  LockCounters counters = stats.counters(kBufMgrLockId);
+  EXPECT_EQ(2, counters.nacquires);
+  EXPECT_EQ(1, counters.ncontended);
+  EXPECT_GT(counters.nspins, 0);
+  EXPECT_GT(counters.nsleeps, 0);
+  EXPECT_GE(counters.wait_usec, 10000);
+  EXPECT_EQ(0, stats.counters(kXidGenLockId).nacquires);
+  EXPECT_EQ(0, stats.pid(1));
+
+  // The instance is the lock the waiter was seen on.
+  EXPECT_EQ(1, stats.instance_counters(event.lock).ncontended);
+
+  LockStats::detach();
+}
+
+TEST(LockStats, CountsUnnamedSpinLocks) {
+  ShmemAllocator shmem(1024 * 1024, 0600, true);
+  LockStats stats(&shmem, 2);
+  LwLock lock;
+  S_LOCK_INIT(&lock);
+
+  // Not attached: nothing is counted.
+  S_LOCK(&lock);
+
+  std::thread waiter([&] {
+    stats.attach(0);
+    S_LOCK(&lock);
+    S_UNLOCK(&lock);
+    LockStats::detach();
+  });
+
+  EXPECT_EQ(&lock, await_wait_event(stats, 0).lock);
+  S_UNLOCK(&lock);
+  waiter.join();
+
+  EXPECT_EQ(1, stats.counters(-1).ncontended);
+  EXPECT_EQ(1, stats.instance_counters(&lock).ncontended);
+  EXPECT_EQ(0, stats.instance_counters(&lock).nacquires);
+}
+
+TEST(LockStats, CountsSemaphoreWaits) {
+  ShmemAllocator shmem(1024 * 1024, 0600, true);
+  LockStats stats(&shmem, 2);
+  Semaphore sema(1, 0600, 1);
+  ASSERT_TRUE(sema.is_ok());
+
+  stats.attach(0);
+
+  // Available right away.
+  sema.acquire(0, false);
+
+  std::thread releaser([&] {
+    WaitEvent event = await_wait_event(stats, 0);
+    EXPECT_EQ(WaitEventType::kSemaphore, event.type);
+    EXPECT_EQ(kSemaphoreLocks, event.lock_id);
+    std::this_thread::sleep_for(10ms);
+    sema.release(0);
+  });
+
+  sema.acquire(0, false);
+  releaser.join();
+
+  LockCounters counters = stats.counters(kSemaphoreLocks);
+  EXPECT_EQ(2, counters.nacquires);
+  EXPECT_EQ(1, counters.ncontended);
+  EXPECT_EQ(1, counters.nsleeps);
+  EXPECT_GE(counters.wait_usec, 5000);
+  EXPECT_EQ(2, stats.instance_counters(&sema).nacquires);
+
+  LockStats::detach();
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,125 @@
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "rdbms/storage/lwlock.hpp"
+
+#include <gtest/gtest.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace rdbms;
+
+TEST(LWLock, SharedHoldersDoNotBlockEachOther) {
+  LWLockWaiter waiter;
+  LWLock::set_my_waiter(&waiter);
+  LWLock lock;
+
+  EXPECT_TRUE(lock.acquire(LWLockMode::kShared));
+  EXPECT_TRUE(lock.try_acquire(LWLockMode::kShared));
+  EXPECT_EQ(2, lock.nshared());
+  EXPECT_FALSE(lock.try_acquire(LWLockMode::kExclusive));
+
+  lock.release();
+  lock.release();
+  EXPECT_TRUE(lock.try_acquire(LWLockMode::kExclusive));
+  EXPECT_TRUE(lock.held_exclusive());
+  EXPECT_FALSE(lock.try_acquire(LWLockMode::kShared));
+
+  lock.release();
+  EXPECT_FALSE(lock.held_exclusive());
+  EXPECT_EQ(0, LOAD(g_interrupt_hold_off_count));
+}
+
+TEST(LWLock, ReadersSeeConsistentState) {
+  LWLock lock;
+  int a = 0;
+  int b = 0;
+  int loops = 20000;
+  int nthreads = 8;
+  std::vector<LWLockWaiter> waiters(nthreads);
+  std::vector<std::thread> threads;
+  std::atomic<int> torn_reads{0};
+
+  for (int i = 0; i < nthreads; i++) {
+    threads.emplace_back([&, i] {
+      LWLock::set_my_waiter(&waiters[i]);
+
+      for (int j = 0; j < loops; j++) {
+        // One writer for every four readers.
+        if ((i + j) % 5 == 0) {
+          lock.acquire(LWLockMode::kExclusive);
+          a++;
+          b++;
+          lock.release();
+        } else {
+          lock.acquire(LWLockMode::kShared);
+
+          if (a != b) {
+            torn_reads++;
+          }
+
+          lock.release();
+        }
+      }
+    });
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(0, torn_reads);
+  EXPECT_EQ(nthreads * loops / 5, a);
+  EXPECT_EQ(a, b);
+  EXPECT_EQ(0, lock.nshared());
+  EXPECT_FALSE(lock.held_exclusive());
+}
+
+TEST(LWLockManager, SharedWithChildProcess) {
+  ShmemAllocator shmem(1024 * 1024, 0600);
+  ASSERT_TRUE(shmem.is_ok());
+
+  LWLockManager lwlocks(&shmem);
+  ASSERT_TRUE(lwlocks.is_ok());
+
+  bool found;
+  auto counter = static_cast<int*>(shmem.init_struct("Counter", 4, &found));
+  auto waiters = static_cast<LWLockWaiter*>(
+      shmem.init_struct("Waiters", 2 * sizeof(LWLockWaiter), &found));
+  ASSERT_NE(nullptr, counter);
+  ASSERT_NE(nullptr, waiters);
+  *counter = 0;
+  ::new (&waiters[0]) LWLockWaiter();
+  ::new (&waiters[1]) LWLockWaiter();
+
+  int loops = 10000;
+  auto increment = [&] {
+    for (int i = 0; i < loops; i++) {
+      lwlocks.acquire(kBufMgrLockId, LWLockMode::kExclusive);
+      *counter = *counter + 1;
+      lwlocks.release(kBufMgrLockId);
+    }
+  };
+
+  pid_t pid = fork();
+  ASSERT_NE(-1, pid);
+
+  if (pid == 0) {
+    LWLock::set_my_waiter(&waiters[1]);
+    increment();
+    _exit(0);
+  }
+
+  LWLock::set_my_waiter(&waiters[0]);
+  increment();
+  waitpid(pid, nullptr, 0);
+
+  EXPECT_EQ(2 * loops, *counter);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
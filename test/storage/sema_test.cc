@@ -0,0 +1,89 @@
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "rdbms/storage/sema.hpp"
+
+#include <gtest/gtest.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace rdbms;
+
+TEST(FutexSemaphore, TryAcquire) {
+  FutexSemaphore sema(2);
+
+  EXPECT_TRUE(sema.try_acquire());
+  EXPECT_TRUE(sema.try_acquire());
+  EXPECT_FALSE(sema.try_acquire());
+
+  sema.release(3);
+  EXPECT_EQ(3, sema.value());
+}
+
+TEST(FutexSemaphore, LockAndUnlock) {
+  FutexSemaphore sema(1);
+  int x = 0;
+  int loops = 10000;
+  int nthreads = 16;
+  std::vector<std::thread> threads;
+
+  for (int i = 0; i < nthreads; i++) {
+    threads.emplace_back([&] {
+      for (int j = 0; j < loops; j++) {
+        sema.acquire(false);
+        x = x + 1;
+        sema.release();
+      }
+    });
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(loops * nthreads, x);
+  EXPECT_EQ(1, sema.value());
+}
+
+TEST(FutexSemaphore, WakeUpOtherProcess) {
+  void* shm = ::mmap(nullptr, 2 * sizeof(FutexSemaphore),
+                     PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  ASSERT_NE(MAP_FAILED, shm);
+
+  auto ping = ::new (shm) FutexSemaphore(0);
+  auto pong = ::new (ping + 1) FutexSemaphore(0);
+  int rounds = 1000;
+
+  pid_t pid = fork();
+  ASSERT_NE(-1, pid);
+
+  if (pid == 0) {
+    for (int i = 0; i < rounds; i++) {
+      ping->acquire(false);
+      pong->release();
+    }
+
+    _exit(0);
+  }
+
+  for (int i = 0; i < rounds; i++) {
+    ping->release();
+    pong->acquire(false);
+  }
+
+  int status;
+  waitpid(pid, &status, 0);
+  EXPECT_EQ(0, WEXITSTATUS(status));
+  EXPECT_EQ(0, ping->value());
+  EXPECT_EQ(0, pong->value());
+
+  ::munmap(shm, 2 * sizeof(FutexSemaphore));
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "rdbms/storage/shmem.hpp"
+
+#include <gtest/gtest.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "rdbms/utils/alloc.hpp"
+
+using namespace rdbms;
+
+static constexpr Size kSegmentSize = 4 * 1024 * 1024;
+
+TEST(ShmemAllocator, AllocIsCacheLineAligned) {
+  ShmemAllocator shmem(kSegmentSize, 0600, true);
+  Size available = shmem.available();
+
+  for (Size size : {1, 63, 64, 65, 1000}) {
+    void* ptr = shmem.alloc(size);
+    ASSERT_NE(nullptr, ptr);
+    EXPECT_EQ(0, reinterpret_cast<std::uintptr_t>(ptr) % CACHE_LINE_SIZE);
+    EXPECT_TRUE(shmem.is_valid(ptr));
+    std::memset(ptr, 0xAB, size);
+  }
+
+  EXPECT_EQ(available - 64 - 64 - 64 - 128 - 1024, shmem.available());
+}
+
+TEST(ShmemAllocator, OutOfMemory) {
+  ShmemAllocator shmem(64 * 1024, 0600, true);
+
+  Size available = shmem.available();
+
+  // A failed request leaves no trace, so smaller ones still fit.
+  EXPECT_EQ(nullptr, shmem.alloc(64 * 1024));
+  EXPECT_EQ(available, shmem.available());
+  EXPECT_NE(nullptr, shmem.alloc(64));
+
+  // Use up the rest; a private segment need not end on a cache line.
+  EXPECT_NE(nullptr, shmem.alloc(shmem.available() / 64 * 64));
+  EXPECT_LT(shmem.available(), 64);
+  EXPECT_EQ(nullptr, shmem.alloc(64));
+}
+
+TEST(ShmemAllocator, ConcurrentAllocDoesNotOverlap) {
+  ShmemAllocator shmem(kSegmentSize, 0600, true);
+  int nthreads = 8;
+  int nallocs = 1000;
+  std::vector<std::vector<std::pair<Pointer, Size>>> chunks(nthreads);
+  std::vector<std::thread> threads;
+
+  for (int i = 0; i < nthreads; i++) {
+    threads.emplace_back([&, i] {
+      for (int j = 0; j < nallocs; j++) {
+        Size size = 1 + (i * 31 + j * 17) % 300;
+        auto ptr = static_cast<Pointer>(shmem.alloc(size));
+        ASSERT_NE(nullptr, ptr);
+        chunks[i].emplace_back(ptr, size);
+      }
+    });
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  std::vector<std::pair<Pointer, Size>> all;
+
+  for (auto& list : chunks) {
+    all.insert(all.end(), list.begin(), list.end());
+  }
+
+  std::sort(all.begin(), all.end());
+
+  for (Size i = 1; i < all.size(); i++) {
+    EXPECT_LE(all[i - 1].first + all[i - 1].second, all[i].first);
+  }
+}
+
+TEST(ShmemAllocator, IndexFindsStructByName) {
+  ShmemAllocator shmem(kSegmentSize, 0600, true);
+  bool found;
+
+  auto counter = static_cast<int*>(shmem.init_struct("Counter", 4, &found));
+  ASSERT_NE(nullptr, counter);
+  EXPECT_FALSE(found);
+  *counter = 42;
+
+  void* other = shmem.init_struct("Other", 4, &found);
+  EXPECT_FALSE(found);
+  EXPECT_NE(counter, other);
+
+  EXPECT_EQ(counter, shmem.init_struct("Counter", 4, &found));
+  EXPECT_TRUE(found);
+  EXPECT_EQ(42, *counter);
+
+  // Size mismatch and names that do not fit are refused.
+  EXPECT_EQ(nullptr, shmem.init_struct("Counter", 8, &found));
+  std::string long_name(ShmemIndexEnt::kKeySize, 'x');
+  EXPECT_EQ(nullptr, shmem.init_struct(long_name.c_str(), 4, &found));
+}
+
+TEST(ShmemAllocator, SegmentTooSmallForIndex) {
+  ShmemAllocator shmem(1024, 0600, true);
+  bool found;
+
+  EXPECT_FALSE(shmem.is_ok());
+  EXPECT_EQ(nullptr, shmem.init_struct("Counter", 4, &found));
+}
+
+TEST(ShmemAllocator, AttachFromChildProcess) {
+  ShmemAllocator shmem(kSegmentSize, 0600);
+  ASSERT_TRUE(shmem.is_ok());
+
+  bool found;
+  auto counter = static_cast<int*>(shmem.init_struct("Counter", 4, &found));
+  ASSERT_NE(nullptr, counter);
+  *counter = 0;
+
+  pid_t pid = fork();
+  ASSERT_NE(-1, pid);
+
+  if (pid == 0) {
+    auto ptr = static_cast<int*>(shmem.init_struct("Counter", 4, &found));
+    *ptr = found ? 1 : -1;
+    _exit(0);
+  }
+
+  waitpid(pid, nullptr, 0);
+  EXPECT_EQ(1, *counter);
+}
+
+TEST(SharedMemory, HugePagesFallBackToRegularPages) {
+  Size page_size = ::sysconf(_SC_PAGESIZE);
+
+  SharedMemory::set_huge_pages(HugePages::kOff);
+
+  {
+    SharedMemory shmem(kSegmentSize + 1, 0600);
+    ASSERT_TRUE(shmem.is_ok());
+    EXPECT_FALSE(shmem.uses_huge_pages());
+    EXPECT_EQ(kSegmentSize + page_size, shmem.mapped_size());
+  }
+
+  // Whether or not the kernel has huge pages reserved, kTry gets a segment.
+  SharedMemory::set_huge_pages(HugePages::kTry);
+
+  {
+    SharedMemory shmem(kSegmentSize + 1, 0600);
+    ASSERT_TRUE(shmem.is_ok());
+
+    if (shmem.uses_huge_pages()) {
+      page_size = MemoryPool::huge_page_size();
+    }
+
+    EXPECT_EQ(TYPE_ALIGN(page_size, kSegmentSize + 1), shmem.mapped_size());
+  }
+}
+
+TEST(SharedMemory, PrefaultMapsWholeSegment) {
+  Size page_size = ::sysconf(_SC_PAGESIZE);
+
+  SharedMemory::set_huge_pages(HugePages::kOff);
+  SharedMemory::set_prefault_workers(4);
+  ShmemAllocator shmem(kSegmentSize, 0600);
+  SharedMemory::set_prefault_workers(0);
+  SharedMemory::set_huge_pages(HugePages::kTry);
+  ASSERT_TRUE(shmem.is_ok());
+
+  // Nothing has touched this chunk yet, its pages are resident all the same.
+  Size size = kSegmentSize / 2;
+  void* ptr = shmem.alloc(size);
+  ASSERT_NE(nullptr, ptr);
+
+  auto start = TYPE_ALIGN(page_size, reinterpret_cast<std::uintptr_t>(ptr));
+  Size npages = size / page_size - 1;
+  std::vector<unsigned char> resident(npages);
+  ASSERT_EQ(0, ::mincore(reinterpret_cast<void*>(start), npages * page_size,
+                         resident.data()));
+  EXPECT_TRUE(std::all_of(resident.begin(), resident.end(),
+                          [](unsigned char c) { return c & 1; }));
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
@@ -25,8 +25,7 @@ void routine(Lock* lock, int n, unsigned long long* sum) {
 }
 
 template <typename Lock>
-void test_lock_and_unlock() {
-  int n = 10101789;
+void test_lock_and_unlock(int n = 10101789) {
   int nthreads = 15;
   vector<thread> thread_groups;
   unsigned long long sum1 = 0;
@@ -55,6 +54,62 @@ TEST(SLock, LockAndUnLock) {
   test_lock_and_unlock<TasLock>();
   test_lock_and_unlock<MutexLock>();
   test_lock_and_unlock<AtomicLock>();
+
+  // Waiters queue in FIFO order, so with more threads than CPUs every
+  // handoff goes to a thread that is not running; compare the locks with
+  // lock_bench instead.
+  test_lock_and_unlock<McsLock>(101789);
+}
+
+TEST(SLock, SpinsPerDelayAdapts) {
+  LwLock lock;
+  S_LOCK_INIT(&lock);
+
+  // Got the lock without sleeping: spinning paid off, so spin longer.
+  int before = spins_per_delay();
+  EXPECT_EQ(0, slock(&lock, __FILE__, __LINE__));
+  EXPECT_GE(spins_per_delay(), before);
+  EXPECT_GT(spins_per_delay(), 10);
+
+  // A holder that stays for long makes us sleep, and spin a bit less.
+  thread holder([&] {
+    this_thread::sleep_for(chrono::milliseconds(50));
+    S_UNLOCK(&lock);
+  });
+
+  before = spins_per_delay();
+  EXPECT_GT(slock(&lock, __FILE__, __LINE__), 0);
+  EXPECT_EQ(before - 1, spins_per_delay());
+
+  holder.join();
+  S_UNLOCK(&lock);
+}
+
+TEST(SLock, McsLockNested) {
+  McsLock outer;
+  McsLock inner;
+  int x = 0;
+  int loops = 10000;
+  vector<thread> threads;
+
+  // Holding two locks at once takes two nodes from the thread's pool.
+  for (int i = 0; i < 4; i++) {
+    threads.emplace_back([&] {
+      for (int j = 0; j < loops; j++) {
+        outer.acquire();
+        inner.acquire();
+        x++;
+        outer.release();
+        inner.release();
+      }
+    });
+  }
+
+  for (auto&& t : threads) {
+    t.join();
+  }
+
+  EXPECT_EQ(4 * loops, x);
 }
 
 int main(int argc, char** argv) {
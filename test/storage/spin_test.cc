@@ -0,0 +1,78 @@
+#include <thread>
+#include <vector>
+
+#include "rdbms/storage/spin.hpp"
+
+#include <gtest/gtest.h>
+
+using namespace rdbms;
+
+TEST(SpinManager, CountsAcquires) {
+  ShmemAllocator shmem(1024 * 1024, 0600, true);
+  SpinManager spins(&shmem);
+  ASSERT_TRUE(spins.is_ok());
+
+  for (int i = 0; i < 3; i++) {
+    spins.acquire(kBufMgrLockId);
+    spins.release(kBufMgrLockId);
+  }
+
+  spins.acquire(kXidGenLockId);
+  spins.release(kXidGenLockId);
+
+  EXPECT_EQ(3, spins.stats(kBufMgrLockId).nacquires);
+  EXPECT_EQ(0, spins.stats(kBufMgrLockId).ndelays);
+  EXPECT_EQ(1, spins.stats(kXidGenLockId).nacquires);
+  EXPECT_EQ(0, spins.stats(kLockMgrLockId).nacquires);
+
+  // A second manager over the same segment finds the locks and counters.
+  SpinManager other(&shmem);
+  EXPECT_EQ(3, other.stats(kBufMgrLockId).nacquires);
+}
+
+TEST(SpinManager, LocksAreIndependent) {
+  ShmemAllocator shmem(1024 * 1024, 0600, true);
+  SpinManager spins(&shmem);
+  ASSERT_TRUE(spins.is_ok());
+
+  int loops = 100000;
+  int nthreads = 4;
+  std::vector<int> counters(nthreads, 0);
+  std::vector<std::thread> threads;
+  int shared = 0;
+
+  for (int i = 0; i < nthreads; i++) {
+    threads.emplace_back([&, i] {
+      auto own = static_cast<LockId>(kOidGenLockId + i);
+
+      for (int j = 0; j < loops; j++) {
+        spins.acquire(own);
+        counters[i]++;
+        spins.release(own);
+
+        spins.acquire(kBufMgrLockId);
+        shared++;
+        spins.release(kBufMgrLockId);
+      }
+    });
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(nthreads * loops, shared);
+  EXPECT_EQ(nthreads * loops, spins.stats(kBufMgrLockId).nacquires);
+
+  for (int i = 0; i < nthreads; i++) {
+    EXPECT_EQ(loops, counters[i]);
+    EXPECT_EQ(loops,
+              spins.stats(static_cast<LockId>(kOidGenLockId + i)).nacquires);
+  }
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
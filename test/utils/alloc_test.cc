@@ -0,0 +1,176 @@
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "rdbms/utils/alloc.hpp"
+
+#include <gtest/gtest.h>
+
+#include "rdbms/utils/aset.hpp"
+
+using namespace rdbms;
+using namespace std;
+
+class BlockCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    MemoryPool::trim_cache();
+    MemoryPool::set_cache_limits(MemoryPool::kDefaultCacheBytes,
+                                 MemoryPool::kDefaultCacheBlocksPerClass);
+  }
+
+  void TearDown() override { MemoryPool::trim_cache(); }
+};
+
+TEST_F(BlockCacheTest, ReuseFreedBlock) {
+  auto before = MemoryPool::cache_stats();
+
+  Memory mem = MemoryPool::allocate(8192);
+  MemoryPool::deallocate(mem.ptr);
+  EXPECT_EQ(1, MemoryPool::cache_stats().cached_blocks);
+
+  // A smaller request in the same size class gets the same block back, with
+  // its full capacity.
+  Memory again = MemoryPool::allocate(5000);
+  EXPECT_EQ(mem.ptr, again.ptr);
+  EXPECT_EQ(8192, again.size);
+  MemoryPool::deallocate(again.ptr);
+
+  auto after = MemoryPool::cache_stats();
+  EXPECT_EQ(before.hits + 1, after.hits);
+  EXPECT_EQ(before.misses + 1, after.misses);
+}
+
+TEST_F(BlockCacheTest, SmallBlocksAreNotCached) {
+  Memory mem = MemoryPool::allocate(MemoryPool::kMinCachedSize - 1);
+  MemoryPool::deallocate(mem.ptr);
+
+  EXPECT_EQ(0, MemoryPool::cache_stats().cached_blocks);
+}
+
+TEST_F(BlockCacheTest, LimitsAreEnforced) {
+  MemoryPool::set_cache_limits(64 * 1024, 2);
+
+  Memory mems[4];
+
+  for (auto& mem : mems) {
+    mem = MemoryPool::allocate(4096);
+  }
+
+  for (auto& mem : mems) {
+    MemoryPool::deallocate(mem.ptr);
+  }
+
+  EXPECT_EQ(2, MemoryPool::cache_stats().cached_blocks);
+
+  // A block larger than the whole cache is never kept, and making room for
+  // a big block trims the smaller ones.
+  Memory big = MemoryPool::allocate(128 * 1024);
+  MemoryPool::deallocate(big.ptr);
+  EXPECT_EQ(2, MemoryPool::cache_stats().cached_blocks);
+
+  Memory medium = MemoryPool::allocate(60 * 1024);
+  MemoryPool::deallocate(medium.ptr);
+  EXPECT_LE(MemoryPool::cache_stats().cached_bytes, 64 * 1024);
+
+  MemoryPool::set_cache_limits(0, 0);
+  EXPECT_EQ(0, MemoryPool::cache_stats().cached_blocks);
+}
+
+// Short queries, each of which fills a fresh context and then destroys it,
+// mostly get their blocks from the cache. aset_bench times the same loop.
+TEST_F(BlockCacheTest, ShortQueries) {
+  auto before = MemoryPool::cache_stats();
+
+  for (int i = 0; i < 100; i++) {
+    AllocSetContext aset(nullptr, "Query", 0, 8 * 1024, 8 * 1024 * 1024);
+
+    for (int j = 0; j < 200; j++) {
+      aset.alloc(64 + j);
+    }
+
+    aset.destroy();
+  }
+
+  auto after = MemoryPool::cache_stats();
+  EXPECT_GT(after.hits - before.hits, after.misses - before.misses);
+}
+
+// Blocks allocated by one thread and freed by another leave both threads
+// counters off, but the total stays exact.
+TEST(MemoryPoolTest, CountersAreAggregatedAcrossThreads) {
+  constexpr int kThreads = 4;
+  constexpr int kBlocks = 100;
+  constexpr Size kBlockSize = 512;
+
+  Size before = MemoryPool::bytes_allocated();
+  vector<vector<void*>> blocks(kThreads);
+  vector<thread> threads;
+
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&blocks, t] {
+      for (int i = 0; i < kBlocks; i++) {
+        blocks[t].push_back(MemoryPool::allocate(kBlockSize).ptr);
+      }
+
+      EXPECT_EQ(kBlocks * kBlockSize, MemoryPool::thread_bytes_allocated());
+    });
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(before + kThreads * kBlocks * kBlockSize,
+            MemoryPool::bytes_allocated());
+
+  std::int64_t thread_bytes = MemoryPool::thread_bytes_allocated();
+
+  for (auto& ptrs : blocks) {
+    for (auto ptr : ptrs) {
+      MemoryPool::deallocate(ptr);
+    }
+  }
+
+  EXPECT_EQ(thread_bytes - kThreads * kBlocks * kBlockSize,
+            MemoryPool::thread_bytes_allocated());
+  EXPECT_EQ(before, MemoryPool::bytes_allocated());
+}
+
+TEST(MemoryPoolTest, HugePageBlocks) {
+  Size page_size = MemoryPool::huge_page_size();
+  auto pages = [] {
+    HugePageStats stats = MemoryPool::huge_page_stats();
+
+    return stats.hugetlb_pages + stats.madvised_pages;
+  };
+
+  Size before = pages();
+
+  // Blocks below the threshold come from malloc().
+  Memory small = MemoryPool::allocate_huge(page_size / 2);
+  EXPECT_EQ(before, pages());
+  MemoryPool::deallocate(small.ptr);
+
+  Memory mem = MemoryPool::allocate_huge(page_size + 1);
+  ASSERT_NE(nullptr, mem.ptr);
+  EXPECT_EQ(before + 2, pages());
+  EXPECT_GE(mem.size, page_size + 1);
+  EXPECT_EQ(mem.size, MemoryPool::capacity(mem.ptr));
+  memset(mem.ptr, 0x7F, mem.size);
+
+  // Growing past the mapping moves the data to a bigger one.
+  Memory grown = MemoryPool::reallocate(mem.ptr, 3 * page_size);
+  ASSERT_NE(nullptr, grown.ptr);
+  EXPECT_EQ(before + 4, pages());
+  EXPECT_EQ(0x7F, static_cast<unsigned char*>(grown.ptr)[mem.size - 1]);
+
+  MemoryPool::deallocate(grown.ptr);
+  EXPECT_EQ(before, pages());
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "rdbms/utils/aset.hpp"
+
+#include <gtest/gtest.h>
+
+#include "rdbms/utils/palloc.hpp"
+#include "rdbms/utils/timer.hpp"
+
+using namespace rdbms;
+using namespace std;
+
+// Built twice, with MEMORY_CONTEXT_CHECKING set to 0 and to 1, so that the
+// cost of chunk checking shows up by comparing the two outputs.
+
+static constexpr Size kBlockSize = 8 * 1024;
+static constexpr Size kMaxBlockSize = 8 * 1024 * 1024;
+
+static void run(const char* name, Size min_size, Size max_size) {
+  int nloops = 200;
+  int nchunks = 10000;
+  AllocSetContext aset(nullptr, "Bench", 0, kBlockSize, kMaxBlockSize);
+  vector<void*> ptrs(nchunks);
+  Timer timer;
+
+  for (int i = 0; i < nloops; i++) {
+    for (int j = 0; j < nchunks; j++) {
+      ptrs[j] = aset.alloc(min_size + j % (max_size - min_size + 1));
+    }
+
+    for (int j = 0; j < nchunks; j++) {
+      aset.free(ptrs[j]);
+    }
+  }
+
+  auto elapsed = timer.elapsed();
+  double nops = 2.0 * nloops * nchunks;
+
+  cout << "[AllocSet] checking=" << MEMORY_CONTEXT_CHECKING << " " << name
+       << ": " << elapsed << "ms, " << nops / 1000 / max(elapsed, 1.0)
+       << "M alloc+free/s" << endl;
+
+  aset.destroy();
+}
+
+TEST(AllocSetBench, SmallChunks) { run("16-64 bytes", 16, 64); }
+
+TEST(AllocSetBench, MediumChunks) { run("256-1024 bytes", 256, 1024); }
+
+TEST(AllocSetBench, LargeChunks) { run("2-8 KB", 2048, 8192); }
+
+// Large chunks live in dedicated blocks. Freeing them in random order used to
+// search the block list for every free, which is quadratic in the number of
+// live large chunks.
+TEST(AllocSetBench, FreeLargeChunksInRandomOrder) {
+  int n = 100000;
+  Size size = AllocSetContext::kChunkLimit + 1;
+  AllocSetContext aset(nullptr, "Bench", 0, kBlockSize, kMaxBlockSize);
+  vector<void*> ptrs;
+
+  for (int i = 0; i < n; i++) {
+    ptrs.push_back(aset.alloc(size));
+  }
+
+  mt19937 gen(42);
+  shuffle(ptrs.begin(), ptrs.end(), gen);
+
+  Timer timer;
+
+  for (auto ptr : ptrs) {
+    aset.free(ptr);
+  }
+
+  cout << "[AllocSet] checking=" << MEMORY_CONTEXT_CHECKING << " free " << n
+       << " large chunks in random order: " << timer.elapsed() << "ms" << endl;
+
+  aset.destroy();
+}
+
+// A per-tuple context that is reset after every tuple, keeping its blocks
+// for the next one.
+TEST(AllocSetBench, RetainBlocksAcrossResets) {
+  int ntuples = 10000;
+  AllocSetContext aset(nullptr, "PerTuple", 0, kBlockSize, kMaxBlockSize);
+  aset.set_retained_limit(256 * 1024);
+  Timer timer;
+
+  for (int i = 0; i < ntuples; i++) {
+    for (int j = 0; j < 300; j++) {
+      aset.alloc(64 + j % 100);
+    }
+
+    aset.reset();
+  }
+
+  BlockRetentionStats stats = aset.retention_stats();
+
+  cout << "[AllocSet] checking=" << MEMORY_CONTEXT_CHECKING << " " << ntuples
+       << " resets: " << timer.elapsed() << "ms, " << stats.clean_resets
+       << " clean, " << stats.reused_blocks << " blocks reused, "
+       << stats.new_blocks << " new" << endl;
+
+  aset.destroy();
+}
+
+// Short queries, each of which fills a fresh context and then destroys it,
+// with freed blocks going back to MemoryPool's cache.
+TEST(AllocSetBench, ShortQueries) {
+  int nqueries = 10000;
+  auto before = MemoryPool::cache_stats();
+  Timer timer;
+
+  for (int i = 0; i < nqueries; i++) {
+    AllocSetContext aset(nullptr, "Query", 0, kBlockSize, kMaxBlockSize);
+
+    for (int j = 0; j < 200; j++) {
+      aset.alloc(64 + j);
+    }
+
+    aset.destroy();
+  }
+
+  auto after = MemoryPool::cache_stats();
+
+  cout << "[AllocSet] checking=" << MEMORY_CONTEXT_CHECKING << " " << nqueries
+       << " queries: " << timer.elapsed() << "ms, "
+       << (after.hits - before.hits) << " cache hits, "
+       << (after.misses - before.misses) << " misses" << endl;
+}
+
+// Compare palloc() with calling the context's alloc() through a pointer to
+// its base class.
+TEST(AllocSetBench, PallocFastPath) {
+  int nloops = 100;
+  int nchunks = 10000;
+  AllocSetContext aset(nullptr, "Bench", 0, kBlockSize, kMaxBlockSize);
+  MemoryContext context = &aset;
+  MemoryContextSwitcher switcher(context);
+  vector<void*> ptrs(nchunks);
+
+  auto run = [&](auto alloc) {
+    Timer timer;
+
+    for (int i = 0; i < nloops; i++) {
+      for (int j = 0; j < nchunks; j++) {
+        ptrs[j] = alloc(16 + j % 200);
+      }
+
+      for (int j = 0; j < nchunks; j++) {
+        pfree(ptrs[j]);
+      }
+    }
+
+    return timer.elapsed();
+  };
+
+  auto virtual_time = run([context](Size size) { return context->alloc(size); });
+  auto palloc_time = run([](Size size) { return palloc(size); });
+
+  cout << "[AllocSet] checking=" << MEMORY_CONTEXT_CHECKING << " "
+       << nloops * nchunks << " chunks: alloc() " << virtual_time
+       << "ms, palloc() " << palloc_time << "ms" << endl;
+
+  aset.destroy();
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
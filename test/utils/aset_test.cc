@@ -0,0 +1,278 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "rdbms/utils/aset.hpp"
+
+#include <gtest/gtest.h>
+
+using namespace rdbms;
+using namespace std;
+
+static constexpr Size kBlockSize = 8 * 1024;
+static constexpr Size kMaxBlockSize = 8 * 1024 * 1024;
+
+TEST(AllocSet, AllocAndFree) {
+  AllocSetContext aset(nullptr, "AllocSet", 0, kBlockSize, kMaxBlockSize);
+  vector<char*> ptrs;
+
+  for (int i = 0; i < 1000; i++) {
+    Size size = 1 + (i * 37) % (2 * AllocSetContext::kChunkLimit);
+    auto ptr = static_cast<char*>(aset.alloc(size));
+    ASSERT_NE(nullptr, ptr);
+    memset(ptr, i & 0xFF, size);
+    ptrs.push_back(ptr);
+  }
+
+  aset.check();
+
+  for (auto ptr : ptrs) {
+    aset.free(ptr);
+  }
+
+  aset.check();
+  aset.destroy();
+  EXPECT_EQ(0, MemoryPool::bytes_allocated());
+}
+
+// Small chunks are packed behind a one-word header, max-aligned, and the
+// owner of any of them can be found from the header alone.
+TEST(AllocSet, CompactChunkHeader) {
+  AllocSetContext aset(nullptr, "AllocSet", 0, kBlockSize, kMaxBlockSize);
+
+  EXPECT_EQ(MAXIMUM_ALIGNOF, kChunkHdrSz);
+
+  auto prev = static_cast<char*>(aset.alloc(16));
+
+  for (int i = 0; i < 100; i++) {
+    auto ptr = static_cast<char*>(aset.alloc(16));
+    EXPECT_EQ(prev + 16 + kChunkHdrSz, ptr);
+    EXPECT_EQ(0, reinterpret_cast<std::uintptr_t>(ptr) % MAXIMUM_ALIGNOF);
+    EXPECT_EQ(&aset, MemoryContextData::chunk_context(ptr));
+    prev = ptr;
+  }
+
+  aset.check();
+  aset.destroy();
+}
+
+// MemoryPool may hand out a block bigger than asked for. The spare room must
+// not be used for small chunks, since the block goes away with its large
+// chunk.
+TEST(AllocSet, LargeChunkOwnsWholeBlock) {
+  AllocSetContext aset(nullptr, "AllocSet", 0, kBlockSize, kMaxBlockSize);
+  Size size = 4 * AllocSetContext::kChunkLimit;
+
+  aset.free(aset.alloc(2 * size));
+
+  auto large = static_cast<char*>(aset.alloc(size));
+  auto small = static_cast<char*>(aset.alloc(16));
+  Size capacity = MemoryPool::capacity(AllocChunkData::cast_ptr(large)->block());
+  EXPECT_FALSE(small >= large && small < large + capacity);
+
+  aset.free(large);
+  aset.free(small);
+  aset.check();
+  aset.destroy();
+}
+
+// A growing buffer that is the last chunk of the active block stays put.
+TEST(AllocSet, ReallocSmallChunkInPlace) {
+  AllocSetContext aset(nullptr, "AllocSet", 0, 4 * kBlockSize, kMaxBlockSize);
+
+  auto buf = static_cast<char*>(aset.alloc(16));
+  memset(buf, 'a', 16);
+
+  for (Size size = 32; size <= AllocSetContext::kChunkLimit; size *= 2) {
+    auto grown = static_cast<char*>(aset.realloc(buf, size));
+    EXPECT_EQ(buf, grown);
+    EXPECT_EQ(size / 2, count(grown, grown + size / 2, 'a'));
+    memset(grown, 'a', size);
+  }
+
+  aset.check();
+  aset.free(buf);
+  aset.destroy();
+}
+
+// Anything else moves, and takes its data along.
+TEST(AllocSet, ReallocSmallChunkMoves) {
+  AllocSetContext aset(nullptr, "AllocSet", 0, kBlockSize, kMaxBlockSize);
+
+  auto ptr = static_cast<char*>(aset.alloc(100));
+  void* next = aset.alloc(100);
+  memset(ptr, 'x', 100);
+
+  auto grown = static_cast<char*>(aset.realloc(ptr, 1000));
+  EXPECT_NE(ptr, grown);
+  EXPECT_EQ(100, count(grown, grown + 100, 'x'));
+
+  // Growing into a large chunk copies, too.
+  auto large = static_cast<char*>(
+      aset.realloc(grown, 2 * AllocSetContext::kChunkLimit));
+  EXPECT_EQ(100, count(large, large + 100, 'x'));
+
+  aset.check();
+  aset.free(large);
+  aset.free(next);
+  aset.destroy();
+}
+
+TEST(AllocSet, KeeperBlockIsUsed) {
+  AllocSetContext aset(nullptr, "AllocSet", kBlockSize, kBlockSize,
+                       kMaxBlockSize);
+  EXPECT_EQ(1, aset.nblocks());
+
+  for (int round = 0; round < 3; round++) {
+    for (int i = 0; i < 10; i++) {
+      aset.alloc(100);
+    }
+
+    EXPECT_EQ(1, aset.nblocks());
+    aset.reset();
+  }
+
+  EXPECT_EQ(0, aset.retention_stats().new_blocks);
+  aset.destroy();
+  EXPECT_EQ(0, aset.nblocks());
+}
+
+// Simulate a per-tuple context that is reset after every tuple. aset_bench
+// times the same loop.
+TEST(AllocSet, RetainBlocksAcrossResets) {
+  int ntuples = 100;
+  AllocSetContext aset(nullptr, "PerTuple", 0, kBlockSize, kMaxBlockSize);
+  aset.set_retained_limit(256 * 1024);
+
+  for (int i = 0; i < ntuples; i++) {
+    for (int j = 0; j < 300; j++) {
+      aset.alloc(64 + j % 100);
+    }
+
+    aset.reset();
+  }
+
+  BlockRetentionStats stats = aset.retention_stats();
+
+  EXPECT_EQ(ntuples, stats.resets);
+  EXPECT_EQ(ntuples, stats.clean_resets);
+  EXPECT_GT(stats.reused_blocks, stats.new_blocks);
+  EXPECT_LE(stats.retained_bytes, aset.retained_limit());
+  aset.check();
+
+  // Without a budget, every block goes.
+  aset.set_retained_limit(0);
+  aset.reset();
+  EXPECT_EQ(0, aset.retention_stats().retained_bytes);
+  EXPECT_EQ(0, aset.nblocks());
+
+  aset.destroy();
+}
+
+// reset() keeps the largest blocks that fit in the limit, whatever order
+// they were allocated in.
+TEST(AllocSet, RetainLargestBlocks) {
+  AllocSetContext aset(nullptr, "AllocSet", 0, kBlockSize, kMaxBlockSize);
+  aset.set_retained_limit(96 * 1024);
+
+  // Fresh blocks only, so every block is as big as asked for.
+  MemoryPool::trim_cache();
+
+  for (Size kb : {20, 40, 10, 50, 30}) {
+    aset.alloc(kb * 1024);
+  }
+
+  aset.reset();
+
+  // The 50K and 40K blocks fit, nothing else does besides them.
+  Size retained = aset.retention_stats().retained_bytes;
+  EXPECT_GT(retained, 90 * 1024);
+  EXPECT_LE(retained, 96 * 1024);
+  EXPECT_EQ(2, aset.nblocks());
+
+  aset.destroy();
+}
+
+TEST(AllocSet, ReallocLargeChunk) {
+  AllocSetContext aset(nullptr, "AllocSet", 0, kBlockSize, kMaxBlockSize);
+  Size size = AllocSetContext::kChunkLimit + 1;
+
+  auto ptr = static_cast<char*>(aset.alloc(size));
+  void* other = aset.alloc(size);
+  memset(ptr, 'x', size);
+
+  auto grown = static_cast<char*>(aset.realloc(ptr, 4 * size));
+  EXPECT_EQ(size, count(grown, grown + size, 'x'));
+
+  aset.free(other);
+  aset.free(grown);
+  aset.destroy();
+  EXPECT_EQ(0, MemoryPool::bytes_allocated());
+}
+
+// Large chunks live in dedicated blocks, unlinked from the block list in
+// constant time whatever order they are freed in. aset_bench times it.
+TEST(AllocSet, FreeLargeChunksInRandomOrder) {
+  int n = 100;
+  Size size = AllocSetContext::kChunkLimit + 1;
+  AllocSetContext aset(nullptr, "AllocSet", 0, kBlockSize, kMaxBlockSize);
+  vector<void*> ptrs;
+
+  for (int i = 0; i < n; i++) {
+    ptrs.push_back(aset.alloc(size));
+  }
+
+  Size allocated = aset.mem_allocated();
+  mt19937 gen(42);
+  shuffle(ptrs.begin(), ptrs.end(), gen);
+
+  for (int i = 0; i < n; i++) {
+    aset.free(ptrs[i]);
+
+    if (i == n / 2) {
+      aset.check();
+      EXPECT_LT(aset.mem_allocated(), allocated);
+      EXPECT_EQ(n - 1 - i, aset.nblocks());
+    }
+  }
+
+  EXPECT_EQ(0, aset.mem_allocated());
+  aset.destroy();
+  EXPECT_EQ(0, MemoryPool::bytes_allocated());
+}
+
+TEST(AllocSet, HugePageLargeChunks) {
+  AllocSetContext aset(nullptr, "AllocSet", 0, kBlockSize, kMaxBlockSize);
+  aset.set_huge_pages(true);
+
+  HugePageStats before = MemoryPool::huge_page_stats();
+  Size size = MemoryPool::huge_page_threshold();
+  auto ptr = static_cast<char*>(aset.alloc(size));
+  ASSERT_NE(nullptr, ptr);
+  memset(ptr, 1, size);
+
+  HugePageStats stats = MemoryPool::huge_page_stats();
+  EXPECT_GT(stats.hugetlb_pages + stats.madvised_pages,
+            before.hugetlb_pages + before.madvised_pages);
+
+  ptr = static_cast<char*>(aset.realloc(ptr, 2 * size));
+  ASSERT_NE(nullptr, ptr);
+  EXPECT_EQ(1, ptr[size - 1]);
+  aset.check();
+
+  aset.free(ptr);
+  stats = MemoryPool::huge_page_stats();
+  EXPECT_EQ(before.hugetlb_pages + before.madvised_pages,
+            stats.hugetlb_pages + stats.madvised_pages);
+
+  aset.destroy();
+  EXPECT_EQ(0, aset.total_allocated());
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,83 @@
+#include <cstring>
+#include <deque>
+#include <vector>
+
+#include "rdbms/utils/generation.hpp"
+
+#include <gtest/gtest.h>
+
+using namespace rdbms;
+
+TEST(Generation, FifoKeepsFootprintFlat) {
+  GenerationContext gen(nullptr, "Generation",
+                        GenerationContext::kDefaultInitBlockSize,
+                        GenerationContext::kDefaultInitBlockSize);
+  std::deque<void*> window;
+  Size peak = 0;
+
+  // Slide a window of live tuples of varying sizes over a long stream. As
+  // old tuples die their blocks are released, so the footprint must stay
+  // bounded by the window rather than by the stream.
+  for (int i = 0; i < 100000; i++) {
+    Size size = 16 + (i * 7) % 200;
+    auto ptr = static_cast<char*>(gen.alloc(size));
+    ASSERT_NE(nullptr, ptr);
+    std::memset(ptr, i & 0xFF, size);
+    window.push_back(ptr);
+
+    if (window.size() > 100) {
+      gen.free(window.front());
+      window.pop_front();
+    }
+
+    peak = std::max(peak, MemoryPool::bytes_allocated());
+  }
+
+  gen.check();
+  EXPECT_LE(peak, 8 * GenerationContext::kDefaultInitBlockSize);
+
+  while (!window.empty()) {
+    gen.free(window.front());
+    window.pop_front();
+  }
+
+  gen.destroy();
+  EXPECT_EQ(0, MemoryPool::bytes_allocated());
+}
+
+TEST(Generation, LargeChunkGetsOwnBlock) {
+  GenerationContext gen(nullptr, "Generation", 1024, 8 * 1024);
+
+  void* small = gen.alloc(32);
+  Size before = MemoryPool::bytes_allocated();
+  void* large = gen.alloc(64 * 1024);
+  EXPECT_GT(MemoryPool::bytes_allocated(), before + 64 * 1024);
+
+  gen.free(large);
+  EXPECT_EQ(before, MemoryPool::bytes_allocated());
+
+  gen.free(small);
+  gen.destroy();
+}
+
+TEST(Generation, ReallocCopies) {
+  GenerationContext gen(nullptr, "Generation", 1024, 8 * 1024);
+
+  auto ptr = static_cast<char*>(gen.alloc(10));
+  std::memcpy(ptr, "generation", 10);
+
+  EXPECT_EQ(ptr, gen.realloc(ptr, 16));
+
+  auto grown = static_cast<char*>(gen.realloc(ptr, 100));
+  EXPECT_EQ(0, std::memcmp(grown, "generation", 10));
+
+  gen.free(grown);
+  gen.check();
+  gen.destroy();
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,128 @@
+#include <string>
+
+#include "rdbms/utils/heap_profiler.hpp"
+
+#include <gtest/gtest.h>
+
+#include "rdbms/utils/aset.hpp"
+#include "rdbms/utils/generation.hpp"
+#include "rdbms/utils/palloc.hpp"
+#include "rdbms/utils/slab.hpp"
+
+using namespace rdbms;
+using namespace std;
+
+static constexpr Size kBlockSize = 8 * 1024;
+static constexpr Size kMaxBlockSize = 8 * 1024 * 1024;
+
+TEST(HeapProfiler, DisabledByDefault) {
+  AllocSetContext aset(nullptr, "AllocSet", 0, kBlockSize, kMaxBlockSize);
+
+  EXPECT_FALSE(HeapProfiler::enabled());
+  aset.alloc(100);
+  EXPECT_EQ(0, HeapProfiler::live_samples(&aset));
+
+  aset.destroy();
+}
+
+// With an interval of one byte every chunk is sampled at its own size.
+TEST(HeapProfiler, SamplesFollowChunks) {
+  AllocSetContext query(nullptr, "Query", 0, kBlockSize, kMaxBlockSize);
+  SlabContext slab(&query, "Slab", SlabContext::kDefaultBlockSize, 64);
+  GenerationContext gen(&query, "Generation", 1024, 8 * 1024);
+
+  HeapProfiler::start(1);
+
+  void* small;
+  {
+    MemoryContextSwitcher switcher(&query);
+    small = palloc(100);
+  }
+
+  void* large = query.alloc(64 * 1024);
+  query.alloc(200);
+  EXPECT_EQ(3, HeapProfiler::live_samples(&query));
+  EXPECT_EQ(100 + 64 * 1024 + 200, HeapProfiler::live_bytes(&query));
+
+  pfree(small);
+  large = repalloc(large, 128 * 1024);
+  EXPECT_EQ(2, HeapProfiler::live_samples(&query));
+  EXPECT_EQ(128 * 1024 + 200, HeapProfiler::live_bytes(&query));
+
+  void* chunk = slab.alloc(64);
+  gen.alloc(32);
+  EXPECT_EQ(64, HeapProfiler::live_bytes(&slab));
+  EXPECT_EQ(32, HeapProfiler::live_bytes(&gen));
+
+  slab.free(chunk);
+  EXPECT_EQ(0, HeapProfiler::live_samples(&slab));
+
+  string report = HeapProfiler::report(&query);
+  EXPECT_NE(string::npos, report.find("Query: 131272 live bytes in 2 samples"));
+  EXPECT_NE(string::npos, report.find("  Generation: 32 live bytes"));
+  EXPECT_NE(string::npos, report.find("  Slab: 0 live bytes"));
+
+  query.reset_subtree();
+  EXPECT_EQ(0, HeapProfiler::live_samples(&query));
+  EXPECT_EQ(0, HeapProfiler::live_samples(&gen));
+
+  HeapProfiler::stop();
+  query.destroy_subtree();
+}
+
+// Sampled sparsely, the weights still add up to the live bytes.
+TEST(HeapProfiler, EstimateIsUnbiased) {
+  AllocSetContext aset(nullptr, "AllocSet", 0, kBlockSize, kMaxBlockSize);
+  Size live = 0;
+
+  HeapProfiler::start(4096);
+
+  for (int i = 0; i < 100000; i++) {
+    Size size = 16 + i % 240;
+    aset.alloc(size);
+    live += size;
+  }
+
+  Size estimate = HeapProfiler::live_bytes(&aset);
+  EXPECT_GT(estimate, live * 8 / 10);
+  EXPECT_LT(estimate, live * 12 / 10);
+
+  HeapProfiler::stop();
+  EXPECT_EQ(0, HeapProfiler::live_samples(&aset));
+  aset.destroy();
+}
+
+// Samples counted before stop() do not leak into the next run.
+TEST(HeapProfiler, RestartAfterStop) {
+  AllocSetContext aset(nullptr, "AllocSet", 0, kBlockSize, kMaxBlockSize);
+
+  HeapProfiler::start(1);
+  void* old_chunk = aset.alloc(100);
+  aset.alloc(200);
+  EXPECT_EQ(2, HeapProfiler::live_samples(&aset));
+
+  HeapProfiler::stop();
+  EXPECT_EQ(0, HeapProfiler::live_samples(&aset));
+  aset.free(old_chunk);
+
+  HeapProfiler::start(1);
+  void* chunk = aset.alloc(300);
+  EXPECT_EQ(1, HeapProfiler::live_samples(&aset));
+  EXPECT_EQ(300, HeapProfiler::live_bytes(&aset));
+
+  aset.free(chunk);
+  EXPECT_EQ(0, HeapProfiler::live_samples(&aset));
+
+  aset.alloc(400);
+  aset.reset();
+  EXPECT_EQ(0, HeapProfiler::live_samples(&aset));
+
+  HeapProfiler::stop();
+  aset.destroy();
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
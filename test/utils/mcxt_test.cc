@@ -0,0 +1,269 @@
+#include <algorithm>
+#include <cstring>
+
+#include "rdbms/utils/mcxt.hpp"
+
+#include <gtest/gtest.h>
+
+#include "rdbms/utils/aset.hpp"
+#include "rdbms/utils/generation.hpp"
+#include "rdbms/utils/slab.hpp"
+
+using namespace rdbms;
+
+static constexpr Size kBlockSize = 8 * 1024;
+static constexpr Size kMaxBlockSize = 8 * 1024 * 1024;
+
+TEST(MemoryContext, AccountingFollowsBlocks) {
+  AllocSetContext query(nullptr, "Query", 0, kBlockSize, kMaxBlockSize);
+  SlabContext slab(&query, "Slab", SlabContext::kDefaultBlockSize, 64);
+
+  query.alloc(100);
+  EXPECT_EQ(1, query.nblocks());
+  EXPECT_EQ(kBlockSize, query.mem_allocated());
+
+  void* big = query.alloc(64 * 1024);
+  EXPECT_EQ(2, query.nblocks());
+  EXPECT_GT(query.mem_allocated(), kBlockSize + 64 * 1024);
+
+  // Chunks carved from an existing block cost nothing.
+  Size allocated = query.mem_allocated();
+  query.alloc(100);
+  EXPECT_EQ(allocated, query.mem_allocated());
+
+  // A child's blocks count towards the parent's total only.
+  slab.alloc(64);
+  EXPECT_EQ(1, slab.nblocks());
+  EXPECT_EQ(slab.mem_allocated(), slab.total_allocated());
+  EXPECT_EQ(allocated, query.mem_allocated());
+  EXPECT_EQ(allocated + slab.mem_allocated(), query.total_allocated());
+
+  Size peak = query.total_allocated();
+  query.free(big);
+  EXPECT_EQ(1, query.nblocks());
+  EXPECT_EQ(peak, query.peak_allocated());
+
+  query.destroy_subtree();
+  EXPECT_EQ(0, query.nblocks());
+  EXPECT_EQ(0, slab.nblocks());
+  EXPECT_EQ(0, query.total_allocated());
+  EXPECT_EQ(peak, query.peak_allocated());
+}
+
+TEST(MemoryContext, LimitCoversSubtree) {
+  AllocSetContext query(nullptr, "Query", 0, kBlockSize, kMaxBlockSize);
+  AllocSetContext child(&query, "Child", 0, kBlockSize, kMaxBlockSize);
+
+  query.set_mem_limit(64 * 1024);
+
+  EXPECT_NE(nullptr, child.alloc(32 * 1024));
+  EXPECT_EQ(nullptr, child.alloc(32 * 1024));
+  EXPECT_EQ(nullptr, query.alloc(32 * 1024));
+
+  // Small chunks still fit.
+  EXPECT_NE(nullptr, query.alloc(100));
+  EXPECT_LE(query.total_allocated(), query.mem_limit());
+
+  // Freeing the big chunk makes room again.
+  child.reset();
+  EXPECT_NE(nullptr, query.alloc(32 * 1024));
+
+  query.destroy_subtree();
+  EXPECT_EQ(0, query.total_allocated());
+}
+
+TEST(MemoryContext, SoftLimitSpills) {
+  AllocSetContext query(nullptr, "Query", 0, kBlockSize, kMaxBlockSize);
+  AllocSetContext hash(&query, "HashTable", 0, kBlockSize, kMaxBlockSize);
+  AllocSetContext sort(&query, "SortBuffer", 0, kBlockSize, kMaxBlockSize);
+  int nspills = 0;
+
+  query.set_soft_mem_limit(128 * 1024);
+  query.set_mem_limit(256 * 1024);
+
+  // The sort buffer gives its memory back when asked to.
+  query.register_spill_callback([&](MemoryContext context) {
+    EXPECT_EQ(&query, context);
+    nspills++;
+    sort.reset();
+  });
+
+  sort.alloc(96 * 1024);
+  EXPECT_EQ(0, nspills);
+
+  // Crossing the soft limit spills the sort buffer and the hash table
+  // carries on.
+  EXPECT_NE(nullptr, hash.alloc(64 * 1024));
+  EXPECT_EQ(1, nspills);
+  EXPECT_EQ(0, sort.total_allocated());
+
+  // Going past the soft limit again fires the callbacks again, since the
+  // spill brought the total back below it.
+  EXPECT_NE(nullptr, hash.alloc(64 * 1024));
+  EXPECT_EQ(2, nspills);
+
+  // Nothing left to spill, so the callbacks stay quiet until the total drops
+  // below the soft limit, and the hard limit fails the allocation.
+  EXPECT_NE(nullptr, hash.alloc(64 * 1024));
+  EXPECT_EQ(nullptr, hash.alloc(64 * 1024));
+  EXPECT_EQ(2, nspills);
+  EXPECT_EQ(2, query.nspills());
+  EXPECT_LE(query.total_allocated(), query.mem_limit());
+
+  hash.reset();
+  hash.alloc(160 * 1024);
+  EXPECT_EQ(3, nspills);
+
+  query.destroy_subtree();
+}
+
+// A spill set off by growing a chunk leaves the chunk intact: realloc()
+// copies the data over before the callbacks run.
+TEST(MemoryContext, SpillDuringRealloc) {
+  AllocSetContext query(nullptr, "Query", 0, kBlockSize, kMaxBlockSize);
+  AllocSetContext hash(&query, "HashTable", 0, kBlockSize, kMaxBlockSize);
+  GenerationContext tuples(&query, "Tuples", 1024, 8 * 1024);
+  AllocSetContext buffer(&query, "SpillBuffer", 0, kBlockSize, kMaxBlockSize);
+
+  query.set_soft_mem_limit(256 * 1024);
+  query.register_spill_callback([&](MemoryContext) { buffer.reset(); });
+  buffer.alloc(128 * 1024);
+
+  Size nbuckets = 64;
+  auto buckets = static_cast<Size*>(hash.alloc(nbuckets * sizeof(Size)));
+
+  for (Size i = 0; i < nbuckets; i++) {
+    buckets[i] = i;
+  }
+
+  while (query.nspills() == 0) {
+    buckets = static_cast<Size*>(
+        hash.realloc(buckets, 2 * nbuckets * sizeof(Size)));
+    ASSERT_NE(nullptr, buckets);
+
+    for (Size i = 0; i < nbuckets; i++) {
+      ASSERT_EQ(i, buckets[i]);
+      buckets[nbuckets + i] = nbuckets + i;
+    }
+
+    nbuckets *= 2;
+  }
+
+  EXPECT_EQ(0, buffer.total_allocated());
+  hash.check();
+  hash.reset();
+
+  // Likewise for a tuple that keeps growing in a generation context.
+  buffer.alloc(128 * 1024);
+  Size size = 64;
+  auto tuple = static_cast<char*>(tuples.alloc(size));
+  std::memset(tuple, 'x', size);
+
+  while (query.nspills() == 1) {
+    tuple = static_cast<char*>(tuples.realloc(tuple, 2 * size));
+    ASSERT_NE(nullptr, tuple);
+    ASSERT_EQ(size, std::count(tuple, tuple + size, 'x'));
+
+    size *= 2;
+    std::memset(tuple, 'x', size);
+  }
+
+  EXPECT_EQ(0, buffer.total_allocated());
+  tuples.check();
+
+  query.destroy_subtree();
+}
+
+TEST(MemoryContext, TreeCounters) {
+  AllocSetContext query(nullptr, "Query", 0, kBlockSize, kMaxBlockSize);
+  AllocSetContext child(&query, "Child", 0, kBlockSize, kMaxBlockSize);
+  GenerationContext gen(&child, "Generation", 1024, 8 * 1024);
+
+  void* ptr = query.alloc(100);
+  query.alloc(100);
+  query.free(ptr);
+  child.alloc(64 * 1024);
+  gen.alloc(32);
+
+  MemoryContextCounters counters = query.counters();
+  EXPECT_EQ(1, counters.nblocks);
+  EXPECT_EQ(1, counters.free_chunks);
+  EXPECT_EQ(query.mem_allocated(), counters.total_space);
+  EXPECT_GE(counters.used_space(), 100);
+
+  MemoryContextCounters totals = query.tree_counters();
+  EXPECT_EQ(3, totals.nblocks);
+  EXPECT_EQ(1, totals.free_chunks);
+  EXPECT_EQ(query.total_allocated(), totals.total_space);
+  EXPECT_EQ(query.peak_allocated(), totals.peak_allocated);
+  EXPECT_EQ(counters.free_space + child.counters().free_space +
+                gen.counters().free_space,
+            totals.free_space);
+
+  query.destroy_subtree();
+  totals = query.tree_counters();
+  EXPECT_EQ(0, totals.nblocks);
+  EXPECT_EQ(0, totals.total_space);
+}
+
+// Freed chunks and the spare room of an oversized block count as free
+// space, not as used.
+TEST(MemoryContext, CountersExcludeFreedSpace) {
+  GenerationContext gen(nullptr, "Generation", 1024, 8 * 1024);
+
+  gen.alloc(100);
+  void* ptr = gen.alloc(200);
+  Size used = gen.counters().used_space();
+
+  gen.free(ptr);
+  MemoryContextCounters counters = gen.counters();
+  EXPECT_EQ(1, counters.free_chunks);
+  EXPECT_LE(used - counters.used_space(), 200 + 64);
+  EXPECT_GE(used - counters.used_space(), 200);
+  gen.check();
+
+  // Leave a 12K block in MemoryPool's cache for the slab to pick up.
+  MemoryPool::trim_cache();
+  MemoryPool::deallocate(MemoryPool::allocate(12 * 1024).ptr);
+
+  SlabContext slab(nullptr, "Slab", SlabContext::kDefaultBlockSize, 64);
+  slab.alloc(64);
+  counters = slab.counters();
+  EXPECT_EQ(slab.mem_allocated(), counters.total_space);
+  EXPECT_GE(counters.total_space, 12 * 1024);
+  EXPECT_LT(counters.used_space(), 1024);
+
+  gen.destroy();
+  slab.destroy();
+  MemoryPool::trim_cache();
+}
+
+TEST(MemoryContext, StatsJson) {
+  AllocSetContext query(nullptr, "Query", 0, kBlockSize, kMaxBlockSize);
+  AllocSetContext first(&query, "First", 0, kBlockSize, kMaxBlockSize);
+  AllocSetContext second(&query, "Say \"hi\"", 0, kBlockSize, kMaxBlockSize);
+
+  EXPECT_EQ(
+      "{\"name\":\"Query\",\"nblocks\":0,\"free_chunks\":0,\"total_space\":0,"
+      "\"free_space\":0,\"used_space\":0,\"peak_allocated\":0,\"children\":["
+      "{\"name\":\"Say \\\"hi\\\"\",\"nblocks\":0,\"free_chunks\":0,"
+      "\"total_space\":0,\"free_space\":0,\"used_space\":0,"
+      "\"peak_allocated\":0,\"children\":[]},"
+      "{\"name\":\"First\",\"nblocks\":0,\"free_chunks\":0,"
+      "\"total_space\":0,\"free_space\":0,\"used_space\":0,"
+      "\"peak_allocated\":0,\"children\":[]}]}",
+      query.stats_json());
+
+  first.alloc(100);
+  std::string json = first.stats_json();
+  EXPECT_NE(std::string::npos, json.find("\"total_space\":8192,"));
+  EXPECT_NE(std::string::npos, json.find("\"children\":[]}"));
+
+  query.destroy_subtree();
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,87 @@
+#include <cstring>
+#include <vector>
+
+#include "rdbms/utils/palloc.hpp"
+
+#include <gtest/gtest.h>
+
+#include "rdbms/utils/generation.hpp"
+#include "rdbms/utils/slab.hpp"
+
+using namespace rdbms;
+using namespace std;
+
+static constexpr Size kBlockSize = 8 * 1024;
+static constexpr Size kMaxBlockSize = 8 * 1024 * 1024;
+
+TEST(Palloc, SwitchContext) {
+  AllocSetContext outer(nullptr, "Outer", 0, kBlockSize, kMaxBlockSize);
+  AllocSetContext inner(&outer, "Inner", 0, kBlockSize, kMaxBlockSize);
+  MemoryContextSwitcher outer_switcher(&outer);
+
+  void* ptr = palloc(100);
+  EXPECT_EQ(&outer, MemoryContextData::chunk_context(ptr));
+
+  {
+    MemoryContextSwitcher inner_switcher(&inner);
+    EXPECT_EQ(&inner, current_memory_context);
+    EXPECT_EQ(&inner, MemoryContextData::chunk_context(palloc(100)));
+
+    // repalloc keeps the chunk in the context that owns it.
+    ptr = repalloc(ptr, 200);
+    EXPECT_EQ(&outer, MemoryContextData::chunk_context(ptr));
+
+    ptr = repalloc(ptr, 2 * AllocSetContext::kChunkLimit);
+    EXPECT_EQ(&outer, MemoryContextData::chunk_context(ptr));
+  }
+
+  EXPECT_EQ(&outer, current_memory_context);
+
+  MemoryContext old_context = memory_context_switch_to(&inner);
+  EXPECT_EQ(&outer, old_context);
+  EXPECT_EQ(&inner, memory_context_switch_to(old_context));
+
+  pfree(ptr);
+  outer.check();
+  outer.destroy_subtree();
+}
+
+TEST(Palloc, FindsOwnerOfAnyContext) {
+  AllocSetContext aset(nullptr, "AllocSet", 0, kBlockSize, kMaxBlockSize);
+  SlabContext slab(nullptr, "Slab", SlabContext::kDefaultBlockSize, 40);
+  GenerationContext gen(nullptr, "Generation", 1024, 8 * 1024);
+
+  vector<void*> ptrs;
+
+  for (MemoryContext context : {static_cast<MemoryContext>(&aset),
+                                static_cast<MemoryContext>(&slab),
+                                static_cast<MemoryContext>(&gen)}) {
+    MemoryContextSwitcher switcher(context);
+
+    for (int i = 0; i < 100; i++) {
+      void* ptr = palloc0(40);
+      ASSERT_NE(nullptr, ptr);
+      EXPECT_EQ(context, MemoryContextData::chunk_context(ptr));
+      EXPECT_EQ(0, static_cast<char*>(ptr)[39]);
+      ptrs.push_back(ptr);
+    }
+  }
+
+  for (auto ptr : ptrs) {
+    pfree(ptr);
+  }
+
+  aset.check();
+  slab.check();
+  gen.check();
+
+  aset.destroy();
+  slab.destroy();
+  gen.destroy();
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
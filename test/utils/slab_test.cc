@@ -0,0 +1,83 @@
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "rdbms/utils/slab.hpp"
+
+#include <gtest/gtest.h>
+
+using namespace rdbms;
+
+struct HashElement {
+  void* next;
+  char key[24];
+  int value;
+};
+
+TEST(Slab, AllocAndFree) {
+  SlabContext slab(nullptr, "Slab", SlabContext::kDefaultBlockSize,
+                   sizeof(HashElement));
+  int n = 10000;
+  std::vector<HashElement*> elements;
+
+  for (int i = 0; i < n; i++) {
+    auto elem = static_cast<HashElement*>(slab.alloc(sizeof(HashElement)));
+    ASSERT_NE(nullptr, elem);
+    EXPECT_EQ(0, reinterpret_cast<uintptr_t>(elem) % MAXIMUM_ALIGNOF);
+
+    elem->value = i;
+    elements.push_back(elem);
+  }
+
+  for (int i = 0; i < n; i++) {
+    EXPECT_EQ(i, elements[i]->value);
+  }
+
+  slab.check();
+
+  std::mt19937 gen(42);
+  std::shuffle(elements.begin(), elements.end(), gen);
+
+  for (auto elem : elements) {
+    slab.free(elem);
+  }
+
+  // Only one empty block is kept around.
+  Size before = MemoryPool::bytes_allocated();
+  EXPECT_LE(before, SlabContext::kDefaultBlockSize);
+
+  slab.destroy();
+  EXPECT_EQ(0, MemoryPool::bytes_allocated());
+}
+
+TEST(Slab, ReuseFreedChunk) {
+  SlabContext slab(nullptr, "Slab", 1024, 40);
+
+  void* p1 = slab.alloc(40);
+  void* p2 = slab.alloc(40);
+  slab.free(p1);
+
+  // The lowest free chunk of the block is handed out first.
+  EXPECT_EQ(p1, slab.alloc(40));
+  EXPECT_EQ(p2, slab.realloc(p2, 32));
+  EXPECT_EQ(nullptr, slab.alloc(41));
+
+  slab.destroy();
+}
+
+TEST(Slab, SmallerFootprintThanPowerOfTwo) {
+  SlabContext slab(nullptr, "Slab", SlabContext::kDefaultBlockSize, 40);
+
+  // 40-byte chunks are packed with an 8-byte header, instead of being
+  // rounded up to 64 bytes behind a 32-byte AllocChunkHeader, which would
+  // fit at most 85 chunks into the same block.
+  EXPECT_GE(slab.chunks_per_block(), 160);
+
+  slab.destroy();
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}